@@ -7,6 +7,9 @@
 #include <vector>
 #include <cmath>
 #include <limits>
+#include <unistd.h>
+#include <thread>
+#include <mutex>
 #include <opencv2/core.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -16,28 +19,91 @@
 
 #include "dataStructures.h"
 #include "matching2D.hpp"
+#include "matchingKernels.hpp"
+#include "descriptorCompression.hpp"
 #include "objectDetection2D.hpp"
+#include "detectorModel.hpp"
 #include "lidarData.hpp"
+#include "lidarIndex.hpp"
+#include "framePreprocessing.hpp"
+#include "framePrefetch.hpp"
+#include "frameStream.hpp"
+#include "sequenceArchive.hpp"
+#include "shardRunner.hpp"
+#include "parameterSearch.hpp"
+#include "metricsExporter.hpp"
+#include "taskPool.hpp"
+#include "frameArena.hpp"
+#include "memoryAccounting.hpp"
 #include "camFusion.hpp"
+#include "fusionSession.hpp"
+#include "syntheticWorkload.hpp"
+#include "logger.hpp"
 
 
 using namespace std;
 
 
-int experiment(string detectorType, string descriptorType, std::map<std::string, std::vector<ExperimentResult>> &result, bool bWait, int upToImgNo);
+int experiment(string detectorType, string descriptorType, std::map<std::string, std::vector<ExperimentResult>> &result, bool bWait, int upToImgNo,
+               string archiveFile = "", int fromImgNo = 0, FrameStream *stream = nullptr, string sequence = "KITTI/2011_09_26",
+               const ExperimentConfig &config = ExperimentConfig());
 void printResult(std::map<std::string, std::vector<ExperimentResult>> &result);
+void seriesCombinations(std::vector<std::pair<string, string>> &combinations);
 void runSeriesOfExperiments();
+void runParameterSearch(int numCandidates, int upToImgNo);
+void runConcurrentSessions(int numSessions, int upToImgNo);
+int coordinateShards(string workDir, int numWorkers, std::vector<string> sequences);
+int runShard(string workDir, int shardID);
+void loadKittiFrame(string dataPath, string sequence, int imgNumber, SensorFrame &sensorFrame);
+bool packSequence(string archiveFile, int upToImgNo, bool bCompressImages);
+void trainDescriptorCompression(int dims, string sequence, int fromImgNo, int upToImgNo);
+void runSyntheticWorkload(int maxLidarPoints, int maxObjects, int maxKeypoints);
 
 
 /* MAIN PROGRAM */
 int main(int argc, const char *argv[])
 {
+    // optional metrics export ahead of the mode: -metrics <port | unix:<socket path>> and/or -metrics-dump <file>,
+    // and the log level: -log <error | warn | info | debug>
+    string metricsEndpoint, metricsDumpFile;
+    while (argc > 2 && (strcmp(argv[1], "-metrics") == 0 || strcmp(argv[1], "-metrics-dump") == 0 || strcmp(argv[1], "-log") == 0))
+    {
+        LogLevel logLevel;
+        if (strcmp(argv[1], "-log") == 0 && parseLogLevel(argv[2], logLevel))
+            setLogLevel(logLevel);
+        else if (strcmp(argv[1], "-log") == 0)
+            LOG_ERROR << "Unknown log level " << argv[2];
+        else
+            (strcmp(argv[1], "-metrics") == 0 ? metricsEndpoint : metricsDumpFile) = argv[2];
+        argv += 2;
+        argc -= 2;
+    }
+
+    std::unique_ptr<MetricsExporter> metricsExporter;
+    if (!metricsEndpoint.empty() || !metricsDumpFile.empty())
+    {
+        double dumpInterval = 10.0; // seconds between two dumps to the file
+        metricsExporter.reset(new MetricsExporter(metrics(), metricsEndpoint, metricsDumpFile, dumpInterval));
+
+        double overheadNs = measureMetricsOverhead();
+        metrics().gauge("fusion_metrics_overhead_ns", "Measured cost of recording one stage latency and counter in ns")->set(overheadNs);
+        LOG_INFO << "Exporting metrics, recording a stage costs " << overheadNs << " ns";
+    }
+
     if (argc > 1)
     {
         if (strcmp(argv[1], "-series") == 0)
         {
 	        runSeriesOfExperiments();
         }
+        if (strcmp(argv[1], "-search") == 0) // -search [no. of configurations] [last image no.]
+        {
+            runParameterSearch(argc > 2 ? atoi(argv[2]) : 81, argc > 3 ? atoi(argv[3]) : 77);
+        }
+        if (strcmp(argv[1], "-sessions") == 0) // -sessions [no. of sessions] [last image no.]
+        {
+            runConcurrentSessions(argc > 2 ? atoi(argv[2]) : 4, argc > 3 ? atoi(argv[3]) : 77);
+        }
         if (strcmp(argv[1], "-single") == 0)
         {
             string detector = "SIFT";     //SHITOMASI, HARRIS, FAST, BRISK, ORB, AKAZE, SIFT
@@ -47,6 +113,61 @@ int main(int argc, const char *argv[])
             experiment(detector, descriptor, result, false, 70);
             printResult(result);
         }
+        if (strcmp(argv[1], "-pack") == 0 && argc > 2) // -pack <archive> [last image no.] [-png]
+        {
+            int upToImgNo = argc > 3 ? atoi(argv[3]) : 77;
+            bool bCompressImages = argc > 4 && strcmp(argv[4], "-png") == 0;
+            if (!packSequence(argv[2], upToImgNo, bCompressImages))
+                return 1;
+        }
+        if (strcmp(argv[1], "-train-compression") == 0) // -train-compression [no. of dimensions] [first image no.] [last image no.] [sequence]
+        {
+            // by default the frames after those of the evaluation runs (0...70), so the accuracy report isn't measured on training data
+            trainDescriptorCompression(argc > 2 ? atoi(argv[2]) : 32, argc > 5 ? argv[5] : "KITTI/2011_09_26", argc > 3 ? atoi(argv[3]) : 71,
+                                       argc > 4 ? atoi(argv[4]) : 77);
+        }
+        if (strcmp(argv[1], "-synthetic") == 0) // -synthetic [max. Lidar points] [max. objects] [max. keypoints]
+        {
+            runSyntheticWorkload(argc > 2 ? atoi(argv[2]) : 4000000, argc > 3 ? atoi(argv[3]) : 64, argc > 4 ? atoi(argv[4]) : 16000);
+        }
+        if (strcmp(argv[1], "-coordinate") == 0 && argc > 3) // -coordinate <work dir> <no. of workers> [sequence ...]
+        {
+            vector<string> sequences(argv + 4, argv + argc);
+            if (sequences.empty())
+                sequences.push_back("KITTI/2011_09_26");
+            return coordinateShards(argv[2], atoi(argv[3]), sequences);
+        }
+        if (strcmp(argv[1], "-shard") == 0 && argc > 3) // -shard <work dir> <shard id>, started by the coordinator
+        {
+            return runShard(argv[2], atoi(argv[3]));
+        }
+        if (strcmp(argv[1], "-stream") == 0 && argc > 2) // -stream <video file | image pattern | pipe:<fifo>> [Lidar file pattern]
+        {
+            string detector = "FAST";     //SHITOMASI, HARRIS, FAST, BRISK, ORB, AKAZE, SIFT
+            string descriptor = "ORB";    // BRISK, ORB, AKAZE, SIFT
+            std::map<std::string, std::vector<ExperimentResult>> result;
+            double frameRate = 10.0;      // sensor frame rate of the recording
+            double deadlineMs = 100.0;    // max. latency from capture to TTC result
+
+            FrameStream stream(argv[2], argc > 3 ? argv[3] : "", frameRate, deadlineMs);
+            if (stream.isOpen())
+            {
+                experiment(detector, descriptor, result, false, 0, "", 0, &stream);
+                printResult(result);
+            }
+        }
+        if (strcmp(argv[1], "-replay") == 0 && argc > 2) // -replay <archive> [first image no.] [last image no.]
+        {
+            string detector = "SIFT";     //SHITOMASI, HARRIS, FAST, BRISK, ORB, AKAZE, SIFT
+            string descriptor = "SIFT";   // BRISK, ORB, AKAZE, SIFT
+            std::map<std::string, std::vector<ExperimentResult>> result;
+            int fromImgNo = argc > 3 ? atoi(argv[3]) : 0;
+            int upToImgNo = argc > 4 ? atoi(argv[4]) : 70;
+
+            if (experiment(detector, descriptor, result, false, upToImgNo, argv[2], fromImgNo) != 0)
+                return 1;
+            printResult(result);
+        }
     }
     else
     {
@@ -64,7 +185,7 @@ int main(int argc, const char *argv[])
 void printResult(std::map<std::string, std::vector<ExperimentResult>> &result)
 {
     ostringstream ss;
-    ss << std::fixed << std::setprecision(1) << "detector_type, descriptor_type, img_id, lidar_ttc, camera_ttc, num_kpts, num_kpts_matched " << std::endl;
+    ss << std::fixed << std::setprecision(1) << "detector_type, descriptor_type, img_id, lidar_ttc, camera_ttc, num_kpts, num_kpts_matched, buffer_kb, num_allocs, alloc_kb, peak_rss_mb " << std::endl;
 
 	for(auto test : result)
     {
@@ -74,32 +195,248 @@ void printResult(std::map<std::string, std::vector<ExperimentResult>> &result)
 		for(auto &item : data)
         {
 			ss << item.detectorType << ", " << item.descriptorType << ", " << item.imgID << ", " << item.ttcLidar << ", ";
-            ss << item.ttcCamera << ", " << item.numOfKeypointsDetected << ", " << item.numOfKeypointsMatched  << std::endl;
+            ss << item.ttcCamera << ", " << item.numOfKeypointsDetected << ", " << item.numOfKeypointsMatched << ", " << item.frameBufferBytes / 1024 << ", ";
+            ss << item.numAllocations << ", " << item.bytesAllocated / 1024 << ", " << item.peakResidentBytes / (1024 * 1024) << std::endl;
 		}
-		std::cout << ss.str() << std::endl;
+		LOG_INFO << ss.str();
 	}
 }
 
 
-void runSeriesOfExperiments()  
+// Detector/descriptor combinations evaluated in a series of experiments
+void seriesCombinations(std::vector<std::pair<string, string>> &combinations)
 {
-	std::map<std::string, std::vector<ExperimentResult>> results;
-
 	for(auto detector:{"HARRIS", "FAST", "BRISK", "ORB", "AKAZE", "SIFT", "SHITOMASI"})
     {
 		for(auto descriptor: {"BRISK", "ORB", "SIFT"})   // "SIFT", "AKAZE"
         {
 			if (string(detector).compare("SIFT") == 0 && string(descriptor).compare("ORB") == 0) continue;
-			experiment(detector, descriptor, results, false, 50);
+			combinations.push_back(make_pair(string(detector), string(descriptor)));
 		}
 	}
+}
+
+
+void runSeriesOfExperiments()  
+{
+	std::map<std::string, std::vector<ExperimentResult>> results;
+
+	std::vector<std::pair<string, string>> combinations;
+	seriesCombinations(combinations);
+	for(auto &combination : combinations)
+		experiment(combination.first, combination.second, results, false, 50);
 
 	printResult(results);
 }
 
 
+// Tune detector/descriptor and thresholds by successive halving instead of running every configuration on all frames
+void runParameterSearch(int numCandidates, int upToImgNo)
+{
+    ParameterSpace space;
+    seriesCombinations(space.combinations);
+    space.fastThresholds = {10, 20, 30, 40};
+    space.maxDescDistRatios = {0.6, 0.7, 0.8, 0.9};
+    space.shrinkFactors = {0.05, 0.10, 0.15, 0.20};
+    space.lidarNthPoints = {3, 5, 7, 11};
+    space.confThresholds = {0.2, 0.3, 0.4};
+
+    int minFrames = 4;           // frames of the first round, multiplied by eta in every further round
+    int eta = 3;                 // only the best 1/eta of the configurations are promoted to the next round
+    double latencyWeight = 0.01; // cost of 1 ms processing time per frame in seconds of TTC instability
+    unsigned int seed = 42;
+
+    std::vector<SearchCandidate> candidates;
+    sampleCandidates(space, numCandidates, seed, candidates);
+
+    successiveHalving(candidates, minFrames, upToImgNo, eta, latencyWeight,
+                      [](const SearchCandidate &candidate, int fromImg, int toImg, std::vector<ExperimentResult> &results)
+    {
+        std::map<std::string, std::vector<ExperimentResult>> result;
+        experiment(candidate.detectorType, candidate.descriptorType, result, false, toImg, "", fromImg, nullptr, "KITTI/2011_09_26", candidate.config);
+        for (auto &test : result)
+            results.insert(results.end(), test.second.begin(), test.second.end());
+    });
+
+    if (!candidates.empty())
+        LOG_INFO << "Best configuration (cost " << candidates.front().cost << "): " << describeCandidate(candidates.front());
+}
+
+
+// Run several independent fusion sessions in one process, one thread per simulated stream. Every session replays the KITTI
+// sequence starting at a different frame, so the streams are not in lockstep; the detector network is loaded only once.
+void runConcurrentSessions(int numSessions, int upToImgNo)
+{
+    string dataPath = "../";
+    FusionSessionConfig config; // FAST/ORB with the KITTI calibration
+
+    vector<std::thread> streams;
+    std::mutex outputMutex;
+    double t = (double)cv::getTickCount();
+
+    for (int s = 0; s < numSessions; ++s)
+    {
+        streams.push_back(std::thread([&, s]()
+        {
+            FusionSession session(config);
+            vector<ObjectTTC> results;
+            int firstImg = (s * 7) % max(upToImgNo, 1);
+
+            for (int imgNumber = firstImg; imgNumber <= upToImgNo; ++imgNumber)
+            {
+                SensorFrame frame;
+                loadKittiFrame(dataPath, "KITTI/2011_09_26", imgNumber, frame);
+                if (frame.cameraImg.empty())
+                    break;
+
+                session.processFrame(frame, 1, results);
+
+                lock_guard<std::mutex> lock(outputMutex);
+                for (const auto &result : results)
+                    LOG_INFO << "Session " << s << ", frame " << frame.imgFile << ", box " << result.boxID << " : TTC Lidar " << result.ttcLidar
+                             << " s, TTC Camera " << result.ttcCamera << " s";
+            }
+        }));
+    }
+
+    for (auto &stream : streams)
+        stream.join();
+
+    t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    LOG_INFO << numSessions << " concurrent sessions finished in " << t << " s";
+}
+
+
+// Run the series of experiments over several sequences on worker processes; an interrupted run is resumed
+// by starting the coordinator again with the same work directory
+int coordinateShards(string workDir, int numWorkers, std::vector<string> sequences)
+{
+    string dataPath = "../";
+    int framesPerShard = 25;  // frames per unit of work (consecutive shards share one frame)
+    int maxAttempts = 3;      // a shard is given up after this many crashed or failed workers
+
+    std::vector<ShardSpec> shards;
+    if (readShardPlan(workDir, shards))
+    {
+        LOG_INFO << "Resuming sharded run with " << shards.size() << " shards from " << workDir;
+    }
+    else
+    {
+        std::vector<std::pair<string, string>> combinations;
+        seriesCombinations(combinations);
+        planShards(dataPath, sequences, combinations, framesPerShard, shards);
+        if (!writeShardPlan(workDir, shards))
+            return 1;
+        LOG_INFO << "Planned " << shards.size() << " shards in " << workDir;
+    }
+
+    // workers are new instances of this program
+    char executable[4096];
+    ssize_t len = readlink("/proc/self/exe", executable, sizeof(executable) - 1);
+    if (len <= 0)
+    {
+        LOG_ERROR << "Couldn't determine the path of the executable";
+        return 1;
+    }
+    executable[len] = '\0';
+
+    int numFailed = runShards(workDir, executable, shards, max(numWorkers, 1), maxAttempts);
+    bool bComplete = mergeShardResults(workDir, shards, workDir + "/results.csv");
+
+    return numFailed == 0 && bComplete ? 0 : 1;
+}
+
+
+// Worker process: run the experiment of one shard and store its results
+int runShard(string workDir, int shardID)
+{
+    std::vector<ShardSpec> shards;
+    if (!readShardPlan(workDir, shards) || shardID < 0 || shardID >= (int)shards.size())
+    {
+        LOG_ERROR << "Unknown shard " << shardID << " in " << workDir;
+        return 1;
+    }
+
+    const ShardSpec &shard = shards[shardID];
+    // workers share the working directory and shards overlap by one frame, so no images are saved
+    ExperimentConfig config;
+    config.bWriteImages = false;
+    std::map<std::string, std::vector<ExperimentResult>> result;
+    experiment(shard.detectorType, shard.descriptorType, result, false, shard.lastImg, "", shard.firstImg, nullptr, shard.sequence, config);
+
+    return writeShardResult(workDir, shard, result) ? 0 : 1;
+}
+
+
+
+// Load camera image and Lidar scan of a frame from the KITTI directory layout
+void loadKittiFrame(string dataPath, string sequence, int imgNumber, SensorFrame &sensorFrame)
+{
+    // camera
+    string imgBasePath = dataPath + "images/";
+    string imgPrefix = sequence + "/image_02/data/000000"; // left camera, color
+    string imgFileType = ".png";
+    int imgFillWidth = 4;  // no. of digits which make up the file index (e.g. img-0001.png)
+
+    // Lidar
+    string lidarPrefix = sequence + "/velodyne_points/data/000000";
+    string lidarFileType = ".bin";
+
+    // assemble filenames for current index
+    ostringstream imgNumberStr;
+    imgNumberStr << setfill('0') << setw(imgFillWidth) << imgNumber;
+    sensorFrame.imgFile = imgNumberStr.str();
+    sensorFrame.imgFullFilename = imgBasePath + imgPrefix + imgNumberStr.str() + imgFileType;
+
+    // load image and 3D Lidar points from file
+    sensorFrame.cameraImg = cv::imread(sensorFrame.imgFullFilename);
+    loadLidarFromFile(sensorFrame.lidarPoints, imgBasePath + lidarPrefix + imgNumberStr.str() + lidarFileType);
+}
+
+
+// Convert the KITTI image and Lidar files into a single memory-mappable sequence archive; the archive is written under a
+// temporary name and only renamed once all frames have been written
+bool packSequence(string archiveFile, int upToImgNo, bool bCompressImages)
+{
+    string dataPath = "../";
+    float lidarScale = 0.001; // quantize Lidar coordinates to 1 mm
 
-int experiment(string detectorType, string descriptorType, std::map<std::string, std::vector<ExperimentResult>> &result, bool bWait, int upToImgNo)
+    string tmpFile = archiveFile + ".tmp";
+    SequenceArchiveWriter writer(tmpFile, bCompressImages, lidarScale);
+    if (!writer.isOpen())
+        return false;
+
+    for (int imgNumber = 0; imgNumber <= upToImgNo; ++imgNumber)
+    {
+        SensorFrame sensorFrame;
+        loadKittiFrame(dataPath, "KITTI/2011_09_26", imgNumber, sensorFrame);
+
+        // pre-crop generously around the ego lane, experiment() applies its own tighter crop on replay
+        float minZ = -3.0, maxZ = 0.0, minX = 0.0, maxX = 30.0, maxY = 5.0, minR = 0.0;
+        cropLidarPoints(sensorFrame.lidarPoints, minX, maxX, maxY, minZ, maxZ, minR);
+
+        if (!writer.addFrame(imgNumber, sensorFrame))
+        {
+            writer.close();
+            remove(tmpFile.c_str());
+            return false;
+        }
+        LOG_INFO << "Packed frame " << sensorFrame.imgFile << " with " << sensorFrame.lidarPoints.size() << " Lidar points";
+    }
+
+    if (!writer.close() || rename(tmpFile.c_str(), archiveFile.c_str()) != 0)
+    {
+        LOG_ERROR << "Couldn't save sequence archive " << archiveFile;
+        remove(tmpFile.c_str());
+        return false;
+    }
+    LOG_INFO << "Saved sequence archive " << archiveFile;
+    return true;
+}
+
+
+int experiment(string detectorType, string descriptorType, std::map<std::string, std::vector<ExperimentResult>> &result, bool bWait, int upToImgNo,
+               string archiveFile, int fromImgNo, FrameStream *stream, string sequence, const ExperimentConfig &config)
 {
     /* INIT VARIABLES AND DATA STRUCTURES */
 
@@ -107,13 +444,11 @@ int experiment(string detectorType, string descriptorType, std::map<std::string,
     string dataPath = "../";
 
     // camera
-    string imgBasePath = dataPath + "images/";
-    string imgPrefix = "KITTI/2011_09_26/image_02/data/000000"; // left camera, color
     string imgFileType = ".png";
-    int imgStartIndex = 0; // first file index to load (assumes Lidar and camera names have identical naming convention)
+    auto outputFile = [&config](string fileName) { return config.bWriteImages ? fileName : string(""); }; // empty : nothing is saved
+    int imgStartIndex = fromImgNo; // first file index to load (assumes Lidar and camera names have identical naming convention)
     int imgEndIndex = upToImgNo;   // last file index to load [there are 78 images total]
     int imgStepWidth = 1; 
-    int imgFillWidth = 4;  // no. of digits which make up the file index (e.g. img-0001.png)
 
     // object detection
     string yoloBasePath = dataPath + "dat/yolo/";
@@ -121,139 +456,418 @@ int experiment(string detectorType, string descriptorType, std::map<std::string,
     string yoloModelConfiguration = yoloBasePath + "yolov3.cfg";
     string yoloModelWeights = yoloBasePath + "yolov3.weights";
 
-    // Lidar
-    string lidarPrefix = "KITTI/2011_09_26/velodyne_points/data/000000";
-    string lidarFileType = ".bin";
+    // replay from a packed sequence archive instead of individual files (see packSequence); the archive has to hold all
+    // frames of the run, a replay never mixes in the loose files
+    SequenceArchive archive;
+    bool bUseArchive = !archiveFile.empty();
+    if (bUseArchive && !archive.open(archiveFile))
+        return 1;
+    for (int imgNumber = imgStartIndex; bUseArchive && imgNumber <= imgEndIndex; imgNumber += imgStepWidth)
+    {
+        if (archive.findFrame(imgNumber) < 0)
+        {
+            LOG_ERROR << "Frame " << imgNumber << " is not in sequence archive " << archiveFile;
+            return 1;
+        }
+    }
 
     // calibration data for camera and lidar
-    cv::Mat P_rect_00(3,4,cv::DataType<double>::type); // 3x4 projection matrix after rectification
-    cv::Mat R_rect_00(4,4,cv::DataType<double>::type); // 3x3 rectifying rotation to make image planes co-planar
-    cv::Mat RT(4,4,cv::DataType<double>::type); // rotation matrix and translation vector
-    
-    RT.at<double>(0,0) = 7.533745e-03; RT.at<double>(0,1) = -9.999714e-01; RT.at<double>(0,2) = -6.166020e-04; RT.at<double>(0,3) = -4.069766e-03;
-    RT.at<double>(1,0) = 1.480249e-02; RT.at<double>(1,1) = 7.280733e-04; RT.at<double>(1,2) = -9.998902e-01; RT.at<double>(1,3) = -7.631618e-02;
-    RT.at<double>(2,0) = 9.998621e-01; RT.at<double>(2,1) = 7.523790e-03; RT.at<double>(2,2) = 1.480755e-02; RT.at<double>(2,3) = -2.717806e-01;
-    RT.at<double>(3,0) = 0.0; RT.at<double>(3,1) = 0.0; RT.at<double>(3,2) = 0.0; RT.at<double>(3,3) = 1.0;
-    
-    R_rect_00.at<double>(0,0) = 9.999239e-01; R_rect_00.at<double>(0,1) = 9.837760e-03; R_rect_00.at<double>(0,2) = -7.445048e-03; R_rect_00.at<double>(0,3) = 0.0;
-    R_rect_00.at<double>(1,0) = -9.869795e-03; R_rect_00.at<double>(1,1) = 9.999421e-01; R_rect_00.at<double>(1,2) = -4.278459e-03; R_rect_00.at<double>(1,3) = 0.0;
-    R_rect_00.at<double>(2,0) = 7.402527e-03; R_rect_00.at<double>(2,1) = 4.351614e-03; R_rect_00.at<double>(2,2) = 9.999631e-01; R_rect_00.at<double>(2,3) = 0.0;
-    R_rect_00.at<double>(3,0) = 0; R_rect_00.at<double>(3,1) = 0; R_rect_00.at<double>(3,2) = 0; R_rect_00.at<double>(3,3) = 1;
-    
-    P_rect_00.at<double>(0,0) = 7.215377e+02; P_rect_00.at<double>(0,1) = 0.000000e+00; P_rect_00.at<double>(0,2) = 6.095593e+02; P_rect_00.at<double>(0,3) = 0.000000e+00;
-    P_rect_00.at<double>(1,0) = 0.000000e+00; P_rect_00.at<double>(1,1) = 7.215377e+02; P_rect_00.at<double>(1,2) = 1.728540e+02; P_rect_00.at<double>(1,3) = 0.000000e+00;
-    P_rect_00.at<double>(2,0) = 0.000000e+00; P_rect_00.at<double>(2,1) = 0.000000e+00; P_rect_00.at<double>(2,2) = 1.000000e+00; P_rect_00.at<double>(2,3) = 0.000000e+00;    
+    cv::Mat P_rect_00, R_rect_00, RT; // 3x4 projection matrix after rectification, rectifying rotation, rotation matrix and translation vector
+    kittiCalibration(P_rect_00, R_rect_00, RT);
 
     // misc
     double sensorFrameRate = 10.0 / imgStepWidth; // frames per second for Lidar and camera
     int dataBufferSize = 2;       // no. of images which are held in memory (ring buffer) at the same time
     vector<DataFrame> dataBuffer; // list of data frames which are held in memory at the same time
     bool bVis = true;            // visualize results
+    int ttcThreads = 4;          // no. of threads evaluating the TTC of matched objects
+    TaskPool ttcPool(ttcThreads);
+    vector<ObjectEvaluation> evaluations; // TTC results of the current frame, kept across frames to reuse its capacity
+
+    // keypoint tracking : follow the previous frame's in-box keypoints with KLT instead of detect/describe/match on every frame
+    bool bTrackKLT = false;
+    int redetectInterval = 5;     // re-detect keypoints at least every N frames...
+    int minNumTracks = 100;       // ...or when fewer tracks than this have survived
+    float maxFwdBwdError = 1.0;   // max. forward-backward tracking error in pixels
+    float minKptDistance = 5.0;   // newly detected keypoints closer than this to a track are dropped
+    int framesSinceDetection = 0;
+
+    // keypoint budget : bounds the no. of keypoints passed on to description, matching and camera TTC for every detector
+    int maxKeypoints = 0;                     // per-frame budget (0 = unlimited)
+    int maxKeypointsPerBox = 0;               // budget per detected object instead, keypoints outside all boxes are dropped (0 = per frame)
+    string keypointSelection = "KPT_GRID";    // KPT_GRID, KPT_ANMS, KPT_BEST
+
+    // descriptor matching : the kernel specialized for the descriptor layout is selected once per run
+    string matcherType = "MAT_KERNEL";            // MAT_BF, MAT_FLANN, MAT_KERNEL
+    string matchDescriptorType = descriptorType.compare("SIFT") == 0 ? "DES_HOG" : "DES_BINARY"; // DES_BINARY, DES_HOG
+    string selectorType = "SEL_KNN";              // SEL_NN, SEL_KNN
+    bool bCrossCheck = false;                     // keep only mutual best matches (MAT_KERNEL only)
+    float maxDescDistRatio = selectorType.compare("SEL_KNN") == 0 ? config.maxDescDistRatio : 0.0; // ratio test of the kernel, disabled for SEL_NN
+    MatchKernel matchKernel = selectMatchKernel(descriptorType, bCrossCheck);
+    bool bUseMatchKernel = matcherType.compare("MAT_KERNEL") == 0;
+    MatchScratch matchScratch;
+    bool bGuidedMatching = false;                 // only compare keypoints close to their motion-predicted position (MAT_KERNEL only)
+    float guidedSearchRadius = 40.0;              // search radius around the predicted position in pixels
+
+    // descriptor compression : match PCA-reduced int8 descriptors instead of the full float descriptors (SIFT only,
+    // the projection is learned offline with -train-compression)
+    bool bCompressDescriptors = false;
+    int compressedDims = 32;                      // 32 or 64
+    int rerankTopK = 4;                           // decide between the best K compressed candidates on the full descriptors (0 = off)
+    bool bReportCompressionAccuracy = true;       // also match the full descriptors and compare
+    DescriptorCompressor compressor;
+    if (bCompressDescriptors)
+        bCompressDescriptors = descriptorType.compare("SIFT") == 0 && loadDescriptorCompressor(descriptorCompressionFile(dataPath, compressedDims), compressor);
+    MatchKernel compressedKernel = selectCompressedMatchKernel(compressedDims, bCrossCheck);
+    if (bCompressDescriptors && rerankTopK > 0 && bGuidedMatching)
+    {
+        LOG_WARN << "Guided matching is not supported with re-ranking of compressed descriptors, matching all keypoints";
+        bGuidedMatching = false;
+    }
+    bool bKeepFullDescriptors = !bCompressDescriptors || rerankTopK > 0 || bReportCompressionAccuracy;
+    MatchAgreement compressionAgreement{0, 0, 0}; // summed over the run
+
+    // ego lane : Lidar points outside this box are removed, the object detector can be restricted to its projection
+    float minZ = -1.5, maxZ = -0.9, minX = 2.0, maxX = 20.0, maxY = 2.0, minR = 0.1; // focus on ego lane
+
+    // object detection input : crop the camera image to the projected ego-lane corridor and letterbox it
+    // instead of stretching the full frame to a square input
+    bool bDetectInCorridor = false;
+    cv::Size corridorInputSize(416, 256);  // detector input in corridor mode (multiples of 32 for YOLO)
+    float corridorMinX = 6.0;              // start of the corridor : a vehicle in the ego lane is seen whole from here on (closer, the
+                                           // lane fills the image width and the crop would be the full image)
+    float corridorMaxZ = 1.0;              // top of vehicles in the corridor (Lidar z, the ground is at about -1.7)
+    float corridorMargin = 0.1;            // margin added on each side, relative to the projected corridor size
+    cv::Rect corridorRoi;                  // projected once the image size is known
+    bool bCompareCorridorDetection = true; // also detect on the full frame at 416x416 and compare the vehicle ahead (not timed as a stage)
+    int corridorFrames = 0, corridorBoth = 0, corridorOnly = 0, fullFrameOnly = 0; // frames with the vehicle ahead found by...
+    double corridorIoU = 0.0, corridorMs = 0.0, fullFrameMs = 0.0; // summed over the compared frames
+
+    // detection skipping : run the object detector only every N frames and propagate the boxes along the keypoint matches in between
+    bool bSkipDetection = false;
+    int detectionInterval = 5;         // run the detector at least every N frames...
+    float minSupportedBoxes = 0.5;     // ...or as soon as fewer of the propagated boxes than this fraction are supported by keypoint matches
+    int minBoxSupport = 5;             // no. of keypoint matches a propagated box needs to count as supported
+    int framesSinceObjectDetection = 0;
+
+    // prefetching : decode images and load Lidar scans on background threads ahead of the main loop
+    int prefetchDepth = 4;        // max. no. of frames loaded ahead of processing
+    int prefetchThreads = 2;      // no. of background loader threads
+
+    auto loadFrame = [&archive, bUseArchive, dataPath, sequence, imgStartIndex, imgStepWidth](int position, SensorFrame &sensorFrame)
+    {
+        int imgNumber = imgStartIndex + position * imgStepWidth;
+        if (bUseArchive)
+            archive.readFrame(archive.findFrame(imgNumber), sensorFrame);
+        else
+            loadKittiFrame(dataPath, sequence, imgNumber, sensorFrame);
+    };
+
+    // live streaming : frames arrive in real time from 'stream' and the files above are not read
+    bool bStreaming = stream != nullptr;
+    double captureTime = 0.0;     // tick count at which the current stream frame was read
+    int prevSensorIndex = -1;     // sensor frame counter of the previous frame, frames may be dropped in between
+
+    int numFrames = bStreaming ? 0 : (imgEndIndex - imgStartIndex) / imgStepWidth + 1;
+    FramePrefetcher prefetcher(loadFrame, numFrames, prefetchDepth, prefetchThreads);
+
+    // metrics : stage latencies, throughput and queue depths, exported while the experiment runs (see main)
+    MetricsRegistry &registry = metrics();
+    string stageMetric = "fusion_stage_latency_ms", stageHelp = "Processing time of a pipeline stage per frame in ms";
+    enum { STAGE_LOAD, STAGE_PREPROCESS, STAGE_DETECT_OBJECTS, STAGE_LIDAR, STAGE_CLUSTER_LIDAR, STAGE_KEYPOINTS, STAGE_DESCRIPTORS,
+           STAGE_MATCH, STAGE_TRACK_BOXES, STAGE_TTC, NUM_STAGES };
+    const char *stageNames[NUM_STAGES] = {"load", "preprocess", "detect_objects", "lidar", "cluster_lidar", "keypoints", "descriptors",
+                                          "match", "track_boxes", "ttc"};
+    vector<MetricHistogram *> stageLatency(NUM_STAGES);
+    for (int stage = 0; stage < NUM_STAGES; ++stage)
+        stageLatency[stage] = registry.histogram(stageMetric, stageHelp, latencyBucketsMs(), "stage=\"" + string(stageNames[stage]) + "\"");
+    MetricHistogram *frameLatency = registry.histogram("fusion_frame_latency_ms", "Processing time of a frame from load to TTC in ms", latencyBucketsMs());
+    MetricCounter *framesProcessed = registry.counter("fusion_frames_processed_total", "Frames processed");
+    MetricCounter *detectorRuns = registry.counter("fusion_object_detector_runs_total", "Frames on which the object detector ran");
+    MetricCounter *keypointsDetected = registry.counter("fusion_keypoints_total", "Keypoints passed on to description and matching");
+    MetricCounter *keypointMatches = registry.counter("fusion_keypoint_matches_total", "Keypoint matches between consecutive frames");
+    MetricCounter *ttcLidarResults = registry.counter("fusion_ttc_results_total", "Valid TTC estimates", "sensor=\"lidar\"");
+    MetricCounter *ttcCameraResults = registry.counter("fusion_ttc_results_total", "Valid TTC estimates", "sensor=\"camera\"");
+    MetricGauge *prefetchQueue = registry.gauge("fusion_prefetch_queue_depth", "Frames loaded ahead of processing");
+    MetricGauge *streamDropped = registry.gauge("fusion_stream_frames_dropped", "Frames dropped by the live stream so far");
+    MetricGauge *arenaCapacity = registry.gauge("fusion_frame_arena_bytes", "Memory reserved by the per-frame arenas");
+    MetricGauge *frameBufferBytes = registry.gauge("fusion_frame_buffer_bytes", "Memory held by the frames in the ring buffer");
+    MetricGauge *residentMemory = registry.gauge("fusion_resident_memory_bytes", "Resident set size of the process");
+    StageTimer stageTimer, frameTimer;
+
+    // memory accounting : heap allocations per stage and the footprint of the buffered frames, reported per frame and per run
+    // (off by default, counting adds to every allocation of this thread and the TTC workers)
+    bool bAccountMemory = false;
+    if (bAccountMemory)
+    {
+        enableAllocationAccounting();
+        countThreadAllocations();
+        LOG_INFO << "Accounting memory, counting an allocation and its free costs " << measureAccountingOverhead() << " ns";
+    }
+    if (!resetPeakResidentBytes())
+        LOG_WARN << "Can't reset the peak resident set size, it includes earlier runs of this process";
+    StageAllocations stageAllocations(NUM_STAGES);
+    AllocationCounters frameAllocations;     // all stages of the current frame
+    size_t bufferBytes = 0, maxBufferBytes = 0;  // footprint of the frames in the ring buffer
+
+    auto measureMemory = [&]()
+    {
+        frameAllocations = AllocationCounters{0, 0, 0, 0};
+        for (const auto &counters : stageAllocations.frame())
+            frameAllocations += counters;
+        bufferBytes = 0;
+        for (const auto &bufferedFrame : dataBuffer)
+            bufferBytes += frameFootprint(bufferedFrame).total();
+        maxBufferBytes = max(maxBufferBytes, bufferBytes);
+    };
+
+    auto stageDone = [&](int stage)
+    {
+        stageTimer.lap(stageLatency[stage]);
+        stageAllocations.lap(stage);
+    };
 
     /* MAIN LOOP OVER ALL IMAGES */
 
-    for (size_t imgIndex = 0; imgIndex <= imgEndIndex - imgStartIndex; imgIndex+=imgStepWidth)
+    for (size_t imgIndex = 0; bStreaming || imgIndex <= imgEndIndex - imgStartIndex; imgIndex+=imgStepWidth)
     {
         /* LOAD IMAGE INTO BUFFER */
 
-        // assemble filenames for current index
-        ostringstream imgNumber;
-        imgNumber << setfill('0') << setw(imgFillWidth) << imgStartIndex + imgIndex;
-        string imgFullFilename = imgBasePath + imgPrefix + imgNumber.str() + imgFileType;
-     
-        // load image from file 
-        cv::Mat img = cv::imread(imgFullFilename);
+        // take the next decoded frame from the prefetch queue or the newest frame of the stream
+        SensorFrame sensorFrame;
+        double stallTime = prefetcher.stallTime();
+        stageTimer.restart();
+        stageAllocations.restart();
+        frameTimer.restart();
+        bool bHaveFrame = bStreaming ? stream->next(sensorFrame, captureTime) : prefetcher.next(sensorFrame);
+        if (!bHaveFrame)
+            break;
+        if (sensorFrame.cameraImg.empty()) // missing file or an image which couldn't be decoded
+        {
+            LOG_ERROR << "Couldn't load the image of " << sensorFrame.imgFullFilename;
+            return 1;
+        }
+
+        // TTC needs the time since the previous processed frame, which spans several sensor frames after drops
+        int sensorFramesElapsed = prevSensorIndex >= 0 ? max(sensorFrame.index - prevSensorIndex, 1) : 1;
+        prevSensorIndex = sensorFrame.index;
 
         // push image into data frame buffer
         DataFrame frame;
-        frame.cameraImg = img;
-        frame.imgFile = imgNumber.str();
+        frame.cameraImg = sensorFrame.cameraImg;
+        frame.imgFile = sensorFrame.imgFile;
         dataBuffer.push_back(frame);
         
         if (dataBuffer.size() > dataBufferSize)
             dataBuffer.erase(dataBuffer.begin());
 
-        cout << "#1 : LOAD IMAGE " << imgFullFilename << " INTO BUFFER done" << endl;
+        LOG_INFO << "#1 : LOAD IMAGE " << sensorFrame.imgFullFilename << " INTO BUFFER done - waited " << prefetcher.stallTime() - stallTime << " ms for I/O";
+        stageDone(STAGE_LOAD);
+        prefetchQueue->set(prefetcher.queueDepth());
+
+        // compute grayscale, pyramid and detector input once for all stages
+        cv::Size detectorInputSize(416, 416);
+        if (bDetectInCorridor && corridorRoi.empty())
+        {
+            corridorRoi = projectLidarCorridor((dataBuffer.end() - 1)->cameraImg.size(), P_rect_00, R_rect_00, RT, corridorMinX, maxX, maxY, minZ, corridorMaxZ, corridorMargin);
+            LOG_INFO << "    object detection restricted to corridor " << corridorRoi;
+        }
+        if (bDetectInCorridor)
+            detectorInputSize = corridorInputSize;
+        float preprocessingTime = preprocessFrame((dataBuffer.end() - 1)->imgProducts, (dataBuffer.end() - 1)->cameraImg, detectorInputSize, bTrackKLT,
+                                                  bDetectInCorridor ? corridorRoi : cv::Rect());
+        LOG_INFO << "    frame preprocessing in " << preprocessingTime << " ms";
+        stageDone(STAGE_PREPROCESS);
 
         // start time measurement for current frame
         double startTime = (double)cv::getTickCount();
 
         /* DETECT & CLASSIFY OBJECTS */
-        float confThreshold = 0.2;
+        float confThreshold = config.confThreshold;
         float nmsThreshold = 0.4;        
-        detectObjects((dataBuffer.end() - 1)->cameraImg, (dataBuffer.end() - 1)->boundingBoxes, confThreshold, nmsThreshold,
-                      yoloBasePath, yoloClassesFile, yoloModelConfiguration, yoloModelWeights, bWait, "3d_objects_yolo_" + frame.imgFile + imgFileType);
+        auto detectCurrentObjects = [&]()
+        {
+            detectObjects((dataBuffer.end() - 1)->cameraImg, (dataBuffer.end() - 1)->boundingBoxes, confThreshold, nmsThreshold,
+                          yoloBasePath, yoloClassesFile, yoloModelConfiguration, yoloModelWeights, bWait, outputFile("3d_objects_yolo_" + frame.imgFile + imgFileType),
+                          &(dataBuffer.end() - 1)->imgProducts.detectorInput, &(dataBuffer.end() - 1)->imgProducts.detectorTransform);
+            framesSinceObjectDetection = 0;
+            detectorRuns->inc();
+        };
+
+        // in skipping mode the boxes are propagated once the keypoint matches are known (see #7)
+        bool bPropagateObjects = false;
+        if (bSkipDetection && dataBuffer.size() > 1)
+        {
+            framesSinceObjectDetection++;
+            bPropagateObjects = framesSinceObjectDetection < detectionInterval;
+        }
 
-        cout << "#2 : DETECT & CLASSIFY OBJECTS done" << endl;
+        double detectionTime = 0.0; // ms
+        if (bPropagateObjects)
+        {
+            LOG_INFO << "#2 : DETECT & CLASSIFY OBJECTS skipped - boxes will be propagated from the previous frame";
+        }
+        else
+        {
+            detectionTime = (double)cv::getTickCount();
+            detectCurrentObjects();
+            detectionTime = 1000.0 * ((double)cv::getTickCount() - detectionTime) / cv::getTickFrequency();
+            LOG_INFO << "#2 : DETECT & CLASSIFY OBJECTS done in " << detectionTime << " ms";
+        }
+        stageDone(STAGE_DETECT_OBJECTS);
+
+        // accuracy of corridor detection : detect on the full frame at 416x416 as well and compare the vehicle ahead (not part
+        // of the stage timing)
+        if (!bPropagateObjects && bDetectInCorridor && bCompareCorridorDetection)
+        {
+            vector<BoundingBox> fullFrameBoxes;
+            double fullFrameTime = (double)cv::getTickCount();
+            detectObjects((dataBuffer.end() - 1)->cameraImg, fullFrameBoxes, confThreshold, nmsThreshold, yoloBasePath, yoloClassesFile,
+                          yoloModelConfiguration, yoloModelWeights, false, "");
+            fullFrameTime = 1000.0 * ((double)cv::getTickCount() - fullFrameTime) / cv::getTickFrequency();
+
+            const vector<BoundingBox> &corridorBoxes = (dataBuffer.end() - 1)->boundingBoxes;
+            int corridorIdx = findVehicleAhead(corridorBoxes, corridorRoi), fullFrameIdx = findVehicleAhead(fullFrameBoxes, corridorRoi);
+            double iou = 0.0;
+            if (corridorIdx >= 0 && fullFrameIdx >= 0)
+            {
+                const cv::Rect &a = corridorBoxes[corridorIdx].roi, &b = fullFrameBoxes[fullFrameIdx].roi;
+                iou = (double)(a & b).area() / max((a | b).area(), 1);
+                corridorBoth++;
+                corridorIoU += iou;
+            }
+            corridorOnly += corridorIdx >= 0 && fullFrameIdx < 0;
+            fullFrameOnly += corridorIdx < 0 && fullFrameIdx >= 0;
+            corridorFrames++;
+            corridorMs += detectionTime;
+            fullFrameMs += fullFrameTime;
+            LOG_INFO << "    vehicle ahead found in corridor " << (corridorIdx >= 0 ? "yes" : "no") << ", full frame " << (fullFrameIdx >= 0 ? "yes" : "no")
+                     << (corridorIdx >= 0 && fullFrameIdx >= 0 ? ", IoU " + to_string(iou) : string("")) << ", full-frame detection in " << fullFrameTime << " ms";
+
+            stageTimer.restart();
+            stageAllocations.restart();
+        }
 
 
         /* CROP LIDAR POINTS */
 
-        // load 3D Lidar points from file
-        string lidarFullFilename = imgBasePath + lidarPrefix + imgNumber.str() + lidarFileType;
-        std::vector<LidarPoint> lidarPoints;
-        loadLidarFromFile(lidarPoints, lidarFullFilename);
+        // 3D Lidar points have been loaded by the prefetcher
+        LidarPointCloud &lidarPoints = sensorFrame.lidarPoints;
 
-        // remove Lidar points based on distance properties
-        float minZ = -1.5, maxZ = -0.9, minX = 2.0, maxX = 20.0, maxY = 2.0, minR = 0.1; // focus on ego lane
+        // remove Lidar points based on distance properties (ego lane box, see above)
         cropLidarPoints(lidarPoints, minX, maxX, maxY, minZ, maxZ, minR);
     
-        (dataBuffer.end() - 1)->lidarPoints = lidarPoints;
+        (dataBuffer.end() - 1)->lidarPoints = std::move(lidarPoints);
+
+        // project the cropped points into the image once, all later ROI queries scan this sparse depth image
+        projectLidarToImage((dataBuffer.end() - 1)->lidarDepth, (dataBuffer.end() - 1)->lidarPoints, (dataBuffer.end() - 1)->cameraImg.size(), P_rect_00, R_rect_00, RT);
 
-        cout << "#3 : CROP LIDAR POINTS done" << endl;
+        LOG_INFO << "#3 : CROP LIDAR POINTS done";
+        stageDone(STAGE_LIDAR);
 
 
         /* CLUSTER LIDAR POINT CLOUD */
 
-        // associate Lidar points with camera-based ROI
-        float shrinkFactor = 0.10; // shrinks each bounding box by the given percentage to avoid 3D object merging at the edges of an ROI
-        clusterLidarWithROI((dataBuffer.end()-1)->boundingBoxes, (dataBuffer.end() - 1)->lidarPoints, shrinkFactor, P_rect_00, R_rect_00, RT);
+        auto clusterCurrentObjects = [&]()
+        {
+            // associate Lidar points with camera-based ROI
+            float shrinkFactor = config.shrinkFactor; // shrinks each bounding box by the given percentage to avoid 3D object merging at the edges of an ROI
+            clusterLidarWithROI((dataBuffer.end()-1)->boundingBoxes, (dataBuffer.end() - 1)->lidarPoints, (dataBuffer.end() - 1)->boxLidarPointIdx,
+                                (dataBuffer.end() - 1)->lidarDepth, shrinkFactor);
+
+            // remove outliers by keeping only the dominant Euclidean cluster within each bounding box
+            bool bClusterLidar = true;
+            if (bClusterLidar)
+            {
+                float clusterTolerance = 0.2; // max. distance in [m] between neighbouring points of the same object
+                int minClusterSize = 5;       // boxes with fewer points are left untouched
+                double clusterTime = clusterLidarPointsInBoxes((dataBuffer.end()-1)->boundingBoxes, (dataBuffer.end()-1)->lidarPoints,
+                                                               (dataBuffer.end()-1)->boxLidarPointIdx, clusterTolerance, minClusterSize);
+                LOG_INFO << "    in-box Lidar clustering of " << (dataBuffer.end()-1)->boundingBoxes.size() << " boxes in " << clusterTime << " ms";
+            }
+
+            // Visualize 3D objects
+            show3DObjects((dataBuffer.end()-1)->boundingBoxes, (dataBuffer.end()-1)->lidarPoints, (dataBuffer.end()-1)->boxLidarPointIdx, cv::Size2f(4.0, 8.5), cv::Size(800, 800), bWait, outputFile("lidar_points_" + frame.imgFile + imgFileType));
 
-        // Visualize 3D objects
-        show3DObjects((dataBuffer.end()-1)->boundingBoxes, cv::Size2f(4.0, 8.5), cv::Size(800, 800), bWait, "lidar_points_" + frame.imgFile + imgFileType);
+            LOG_INFO << "#4 : CLUSTER LIDAR POINT CLOUD done";
+        };
 
-        cout << "#4 : CLUSTER LIDAR POINT CLOUD done" << endl;
+        if (!bPropagateObjects)
+            clusterCurrentObjects();
+        stageDone(STAGE_CLUSTER_LIDAR);
         
         /* DETECT IMAGE KEYPOINTS */
 
-        // convert current image to grayscale
-        cv::Mat imgGray;
-        cv::cvtColor((dataBuffer.end()-1)->cameraImg, imgGray, cv::COLOR_BGR2GRAY);
+        // grayscale image has been computed during preprocessing
+        cv::Mat &imgGray = (dataBuffer.end() - 1)->imgProducts.gray;
 
         // extract 2D keypoints from current image
         vector<cv::KeyPoint> keypoints; // create empty feature list for current image
+        vector<cv::DMatch> trackedMatches;
+        bool bDetectKeypoints = true;
 
-        float detectorTime = detKeypoints(keypoints, imgGray, detectorType, false, "keypoints_" + detectorType + "_" + frame.imgFile + imgFileType);
-
-        // optional : limit number of keypoints (helpful for debugging and learning)
-        bool bLimitKpts = false;
-        if (bLimitKpts)
+        if (bTrackKLT && dataBuffer.size() > 1)
         {
-            int maxKeypoints = 50;
+            trackKeypointsKLT((dataBuffer.end() - 2)->keypoints, keypoints, (dataBuffer.end() - 2)->imgProducts, (dataBuffer.end() - 1)->imgProducts,
+                              (dataBuffer.end() - 2)->boundingBoxes, trackedMatches, maxFwdBwdError);
 
-            if (detectorType.compare("SHITOMASI") == 0)
-            { // there is no response info, so keep the first 50 as they are sorted in descending quality order
-                keypoints.erase(keypoints.begin() + maxKeypoints, keypoints.end());
-            }
-            cv::KeyPointsFilter::retainBest(keypoints, maxKeypoints);
-            cout << " NOTE: Keypoints have been limited!" << endl;
+            framesSinceDetection++;
+            bDetectKeypoints = framesSinceDetection >= redetectInterval || trackedMatches.size() < minNumTracks;
+
+            LOG_INFO << "#5 : TRACK KEYPOINTS done - " << trackedMatches.size() << " tracks";
+        }
+
+        if (bDetectKeypoints)
+        {
+            // the per-frame budget also bounds the corners the Shi-Tomasi detector extracts
+            bool bBudgetPerBox = maxKeypointsPerBox > 0 && !bPropagateObjects; // propagated boxes are only known after matching
+            vector<cv::KeyPoint> detectedKeypoints;
+            float detectorTime = detKeypoints(detectedKeypoints, imgGray, detectorType, false, outputFile("keypoints_" + detectorType + "_" + frame.imgFile + imgFileType),
+                                              config.fastThreshold, bBudgetPerBox ? 0 : maxKeypoints);
+
+            // limit the no. of keypoints, spread evenly over the image or the detected objects
+            size_t numDetected = detectedKeypoints.size();
+            if (bBudgetPerBox)
+                selectKeypointsInBoxes(detectedKeypoints, (dataBuffer.end() - 1)->boundingBoxes, maxKeypointsPerBox, keypointSelection);
+            else if (maxKeypoints > 0)
+                selectKeypoints(detectedKeypoints, maxKeypoints, keypointSelection, cv::Rect(0, 0, imgGray.cols, imgGray.rows));
+            if (detectedKeypoints.size() < numDetected)
+                LOG_INFO << "    keypoint budget kept " << detectedKeypoints.size() << " of " << numDetected << " keypoints";
+
+            // in tracking mode, fresh keypoints only replenish the surviving tracks
+            mergeDetectedKeypoints(keypoints, detectedKeypoints, bTrackKLT ? minKptDistance : 0.0);
+            framesSinceDetection = 0;
+
+            LOG_INFO << "#5 : DETECT KEYPOINTS done";
         }
 
         // push keypoints and descriptor for current frame to end of data buffer
         (dataBuffer.end() - 1)->keypoints = keypoints;
-
-        cout << "#5 : DETECT KEYPOINTS done" << endl;
+        keypointsDetected->inc(keypoints.size());
+        stageDone(STAGE_KEYPOINTS);
 
 
         /* EXTRACT KEYPOINT DESCRIPTORS */
 
-        cv::Mat descriptors;
-        descKeypoints((dataBuffer.end() - 1)->keypoints, (dataBuffer.end() - 1)->cameraImg, descriptors, descriptorType);
+        if (!bTrackKLT) // tracks are associated by optical flow, descriptors are not needed
+        {
+            cv::Mat descriptors;
+            descKeypoints((dataBuffer.end() - 1)->keypoints, imgGray, descriptors, descriptorType); // extractors would convert colour input to gray again
 
-        // push descriptors for current frame to end of data buffer
-        (dataBuffer.end() - 1)->descriptors = descriptors;
+            // reduce the descriptors once, they are matched against the next frame as well
+            if (bCompressDescriptors)
+            {
+                float compressionTime = compressDescriptors(compressor, descriptors, (dataBuffer.end() - 1)->compressedDescriptors);
+                LOG_INFO << "    compressed descriptors to " << compressedDims << " int8 dimensions in " << compressionTime << " ms";
+            }
 
-        cout << "#6 : EXTRACT DESCRIPTORS done" << endl;
+            // push descriptors for current frame to end of data buffer
+            if (bKeepFullDescriptors)
+                (dataBuffer.end() - 1)->descriptors = descriptors;
+
+            LOG_INFO << "#6 : EXTRACT DESCRIPTORS done";
+        }
+        stageDone(STAGE_DESCRIPTORS);
 
 
         if (dataBuffer.size() > 1) // wait until at least two images have been processed
@@ -262,79 +876,143 @@ int experiment(string detectorType, string descriptorType, std::map<std::string,
 
         	vector<cv::DMatch> matches;
 
-            string matcherType = "MAT_FLANN";             // MAT_BF, MAT_FLANN
-            string matchDescriptorType = "DES_BINARY";    // DES_BINARY, DES_HOG
-            string selectorType = "SEL_KNN";              // SEL_NN, SEL_KNN
-
-            matchDescriptors((dataBuffer.end() - 2)->keypoints, (dataBuffer.end() - 1)->keypoints,
-                             (dataBuffer.end() - 2)->descriptors, (dataBuffer.end() - 1)->descriptors,
-                             matches, matchDescriptorType, matcherType, selectorType);
+            if (bTrackKLT)
+            {
+                matches = trackedMatches;
+            }
+            else
+            {
+                bool bKernelMatched = false;
+                if (bCompressDescriptors && rerankTopK > 0)
+                    bKernelMatched = matchCompressedReranked((dataBuffer.end() - 2)->compressedDescriptors, (dataBuffer.end() - 1)->compressedDescriptors,
+                                                             (dataBuffer.end() - 2)->descriptors, (dataBuffer.end() - 1)->descriptors,
+                                                             rerankTopK, maxDescDistRatio, matches) >= 0;
+                else if (bCompressDescriptors && bGuidedMatching)
+                    bKernelMatched = matchDescriptorsGuided(compressedKernel, (dataBuffer.end() - 2)->keypoints, (dataBuffer.end() - 1)->keypoints,
+                                                            (dataBuffer.end() - 2)->compressedDescriptors, (dataBuffer.end() - 1)->compressedDescriptors,
+                                                            (dataBuffer.end() - 2)->boundingBoxes, guidedSearchRadius, matches, maxDescDistRatio, matchScratch) >= 0;
+                else if (bCompressDescriptors)
+                    bKernelMatched = matchDescriptorsKernel(compressedKernel, (dataBuffer.end() - 2)->compressedDescriptors, (dataBuffer.end() - 1)->compressedDescriptors,
+                                                            matches, maxDescDistRatio, matchScratch) >= 0;
+                else if (bUseMatchKernel && bGuidedMatching)
+                    bKernelMatched = matchDescriptorsGuided(matchKernel, (dataBuffer.end() - 2)->keypoints, (dataBuffer.end() - 1)->keypoints,
+                                                            (dataBuffer.end() - 2)->descriptors, (dataBuffer.end() - 1)->descriptors,
+                                                            (dataBuffer.end() - 2)->boundingBoxes, guidedSearchRadius, matches, maxDescDistRatio, matchScratch) >= 0;
+                else if (bUseMatchKernel)
+                    bKernelMatched = matchDescriptorsKernel(matchKernel, (dataBuffer.end() - 2)->descriptors, (dataBuffer.end() - 1)->descriptors,
+                                                            matches, maxDescDistRatio, matchScratch) >= 0;
+
+                if (!bKernelMatched) // no kernel for this descriptor layout, fall back to the OpenCV matchers (brute force for MAT_KERNEL)
+                    matchDescriptors((dataBuffer.end() - 2)->keypoints, (dataBuffer.end() - 1)->keypoints,
+                                     (dataBuffer.end() - 2)->descriptors, (dataBuffer.end() - 1)->descriptors,
+                                     matches, matchDescriptorType, bUseMatchKernel ? "MAT_BF" : matcherType, selectorType, maxDescDistRatio);
+            }
 
             // store matches in current data frame
             (dataBuffer.end() - 1)->kptMatches = matches;
 
-            cout << "#7 : MATCH KEYPOINT DESCRIPTORS done - found " << (dataBuffer.end() - 1)->kptMatches.size() << " kpt matches " << endl;
+            LOG_INFO << "#7 : MATCH KEYPOINT DESCRIPTORS done - found " << (dataBuffer.end() - 1)->kptMatches.size() << " kpt matches ";
+            keypointMatches->inc(matches.size());
+            stageDone(STAGE_MATCH);
+
+            // accuracy of compressed matching : match the full descriptors as well (not part of the stage timing)
+            if (bCompressDescriptors && bReportCompressionAccuracy && !bTrackKLT)
+            {
+                vector<cv::DMatch> referenceMatches;
+                if (bGuidedMatching)
+                    matchDescriptorsGuided(matchKernel, (dataBuffer.end() - 2)->keypoints, (dataBuffer.end() - 1)->keypoints,
+                                           (dataBuffer.end() - 2)->descriptors, (dataBuffer.end() - 1)->descriptors,
+                                           (dataBuffer.end() - 2)->boundingBoxes, guidedSearchRadius, referenceMatches, maxDescDistRatio, matchScratch);
+                else
+                    matchDescriptorsKernel(matchKernel, (dataBuffer.end() - 2)->descriptors, (dataBuffer.end() - 1)->descriptors,
+                                           referenceMatches, maxDescDistRatio, matchScratch);
+
+                MatchAgreement agreement = compareMatches(referenceMatches, matches);
+                compressionAgreement.numReference += agreement.numReference;
+                compressionAgreement.numCompressed += agreement.numCompressed;
+                compressionAgreement.numAgreeing += agreement.numAgreeing;
+                LOG_INFO << "    compressed matching : " << agreement.numAgreeing << " of " << agreement.numCompressed << " matches agree with the "
+                         << agreement.numReference << " matches of the full descriptors";
+
+                stageTimer.restart();
+                stageAllocations.restart();
+            }
+
+            map<int, int> bbBestMatches;
+
+            if (bPropagateObjects)
+            {
+                // move the previous frame's boxes along their keypoint matches, they keep their boxIDs
+                float supportedBoxes = propagateBoundingBoxes(matches, *(dataBuffer.end()-2), *(dataBuffer.end()-1), minBoxSupport, bbBestMatches);
+                LOG_INFO << "    propagated " << (dataBuffer.end()-1)->boundingBoxes.size() << " boxes, " << 100.0 * supportedBoxes << " % supported by keypoint matches";
+
+                if (supportedBoxes < minSupportedBoxes)
+                {
+                    // tracking has become unreliable, fall back to the detector for this frame; the detector numbers its boxes
+                    // from zero, so the propagated boxes and their membership arrays are dropped first
+                    (dataBuffer.end() - 1)->boundingBoxes.clear();
+                    (dataBuffer.end() - 1)->boxLidarPointIdx.clear();
+                    (dataBuffer.end() - 1)->boxKptMatchIdx.clear();
+                    detectCurrentObjects();
+                    bbBestMatches.clear();
+                    bPropagateObjects = false;
+                    LOG_INFO << "#2 : DETECT & CLASSIFY OBJECTS done - tracking confidence too low";
+                }
+
+                // the Lidar association follows the boxes
+                clusterCurrentObjects();
+            }
 
             
             /* TRACK 3D OBJECT BOUNDING BOXES */
 
             //// STUDENT ASSIGNMENT
             //// TASK FP.1 -> match list of 3D objects (vector<BoundingBox>) between current and previous frame (implement ->matchBoundingBoxes)
-            map<int, int> bbBestMatches;
-            matchBoundingBoxes(matches, bbBestMatches, *(dataBuffer.end()-2), *(dataBuffer.end()-1)); // associate bounding boxes between current and previous frame using keypoint matches
+            if (!bPropagateObjects) // propagated boxes are matched to their origin by boxID
+                matchBoundingBoxes(matches, bbBestMatches, *(dataBuffer.end()-2), *(dataBuffer.end()-1)); // associate bounding boxes between current and previous frame using keypoint matches
            
-			show3DObjects((dataBuffer.end()-1)->boundingBoxes, cv::Size2f(4.0, 8.5), 
-                                                               cv::Size(800, 800), bWait, "3d_objects_" + frame.imgFile + imgFileType);
+			show3DObjects((dataBuffer.end()-1)->boundingBoxes, (dataBuffer.end()-1)->lidarPoints, (dataBuffer.end()-1)->boxLidarPointIdx, cv::Size2f(4.0, 8.5), 
+                                                               cv::Size(800, 800), bWait, outputFile("3d_objects_" + frame.imgFile + imgFileType));
             //// EOF STUDENT ASSIGNMENT
 
             // store matches in current data frame
             (dataBuffer.end()-1)->bbMatches = bbBestMatches;
+            estimateBoxMotion(bbBestMatches, *(dataBuffer.end()-2), *(dataBuffer.end()-1)); // motion prior for guided matching in the next frame
 
-            cout << "#8 : TRACK 3D OBJECT BOUNDING BOXES done - found " << bbBestMatches.size() << " matching box pairs between frames." << endl;
+            LOG_INFO << "#8 : TRACK 3D OBJECT BOUNDING BOXES done - found " << bbBestMatches.size() << " matching box pairs between frames.";
+            stageDone(STAGE_TRACK_BOXES);
 
             /* COMPUTE TTC ON OBJECT IN FRONT */
 
-            // loop over all BB match pairs
-            for (auto it1 = (dataBuffer.end() - 1)->bbMatches.begin(); it1 != (dataBuffer.end() - 1)->bbMatches.end(); ++it1)
+            // evaluate all BB match pairs in parallel
+            evaluateObjects(*(dataBuffer.end() - 2), *(dataBuffer.end() - 1), sensorFrameRate / sensorFramesElapsed, ttcPool, evaluations,
+                            config.lidarNthPoint);
+            stageDone(STAGE_TTC);
+            measureMemory();
+            for (const auto &evaluation : evaluations)
             {
-                // find bounding boxes associates with current match
-                BoundingBox *prevBB, *currBB;
-
-                for (auto it2 = (dataBuffer.end() - 1)->boundingBoxes.begin(); it2 != (dataBuffer.end() - 1)->boundingBoxes.end(); ++it2)
-                {
-                    if (it1->second == it2->boxID) // check wether current match partner corresponds to this BB
-                    {
-                        currBB = &(*it2);
-                    }
-                }
+                if (std::isfinite(evaluation.ttcLidar))
+                    ttcLidarResults->inc();
+                if (std::isfinite(evaluation.ttcCamera))
+                    ttcCameraResults->inc();
+            }
 
-                for (auto it2 = (dataBuffer.end() - 2)->boundingBoxes.begin(); it2 != (dataBuffer.end() - 2)->boundingBoxes.end(); ++it2)
-                {
-                    if (it1->first == it2->boxID) // check wether current match partner corresponds to this BB
-                    {
-                        prevBB = &(*it2);
-                    }
-                }
+            for (auto it1 = evaluations.begin(); it1 != evaluations.end(); ++it1)
+            {
+                BoundingBox *prevBB = &(dataBuffer.end() - 2)->boundingBoxes[it1->prevBoxIdx];
+                BoundingBox *currBB = &(dataBuffer.end() - 1)->boundingBoxes[it1->currBoxIdx];
 
-                 // compute TTC for current match
-                if( currBB->lidarPoints.size()>0 && prevBB->lidarPoints.size()>0 ) // only compute TTC if we have Lidar points
+                if (it1->bLidarSufficient)
                 {
                     //// STUDENT ASSIGNMENT
                     //// TASK FP.2 -> compute time-to-collision based on Lidar data (implement -> computeTTCLidar)
-                    double ttcLidar; 
-                    computeTTCLidar(prevBB->lidarPoints, currBB->lidarPoints, sensorFrameRate, ttcLidar);
-                    //// EOF STUDENT ASSIGNMENT
-
-                    //// STUDENT ASSIGNMENT
                     //// TASK FP.3 -> assign enclosed keypoint matches to bounding box (implement -> clusterKptMatchesWithROI)
                     //// TASK FP.4 -> compute time-to-collision based on camera (implement -> computeTTCCamera)
-                    double ttcCamera;
-                    clusterKptMatchesWithROI(*currBB, (dataBuffer.end() - 2)->keypoints, (dataBuffer.end() - 1)->keypoints, (dataBuffer.end() - 1)->kptMatches);
-                    
-                    computeTTCCamera((dataBuffer.end() - 2)->keypoints, (dataBuffer.end() - 1)->keypoints, currBB->kptMatches, sensorFrameRate, ttcCamera);
+                    double ttcLidar = it1->ttcLidar;
+                    double ttcCamera = it1->ttcCamera;
                     //// EOF STUDENT ASSIGNMENT
 
-                    cout << "TTC Lidar :" << ttcLidar << ", TTC Camera : " << ttcCamera << endl;
+                    LOG_INFO << "Box " << prevBB->boxID << " -> " << currBB->boxID << " : TTC Lidar :" << ttcLidar << ", TTC Camera : " << ttcCamera;
 
                     double processingTime = 1000.0 * (((double)cv::getTickCount() - startTime) / (double)cv::getTickFrequency());
 
@@ -348,10 +1026,17 @@ int experiment(string detectorType, string descriptorType, std::map<std::string,
                     r.numOfKeypointsMatched = (dataBuffer.end() - 1)->kptMatches.size();
                     r.imgID = frame.imgFile;
                     r.processingTime = processingTime;
+                    r.frameBufferBytes = bufferBytes;
+                    r.numAllocations = frameAllocations.numAllocations;
+                    r.bytesAllocated = frameAllocations.bytesAllocated;
+                    r.peakResidentBytes = peakResidentBytes();
                     result[detectorName].push_back(r);
 
+                    if (!bWait && !config.bWriteImages)
+                        continue; // the visualization is neither shown nor saved
+
                     cv::Mat visImg = (dataBuffer.end() - 1)->cameraImg.clone();
-                    showLidarImgOverlay(visImg, currBB->lidarPoints, P_rect_00, R_rect_00, RT, &visImg);
+                    showLidarImgOverlay(visImg, (dataBuffer.end() - 1)->lidarDepth, (dataBuffer.end() - 1)->boxLidarPointIdx, currBB->lidarPoints, currBB->roi, &visImg);
                     cv::rectangle(visImg, cv::Point(currBB->roi.x, currBB->roi.y), cv::Point(currBB->roi.x + currBB->roi.width, currBB->roi.y + currBB->roi.height), cv::Scalar(0, 255, 0), 2);
                     
                     char str[200];
@@ -363,7 +1048,7 @@ int experiment(string detectorType, string descriptorType, std::map<std::string,
                         string windowName = "Final Results : TTC";
                         cv::namedWindow(windowName, 1);
                         cv::imshow(windowName, visImg);
-                        cout << "Press key to continue to next frame" << endl;
+                        LOG_INFO << "Press key to continue to next frame";
                         cv::waitKey(0);
                     }
                     else
@@ -376,25 +1061,226 @@ int experiment(string detectorType, string descriptorType, std::map<std::string,
                         }
                         catch (const cv::Exception& ex)
                         {
-                            std::cout << "Exception converting image in experiment: " << ex.what() << std::endl;
+                            LOG_ERROR << "Exception converting image in experiment: " << ex.what();
                         }
                         if (resultWriteOp)
-                            std::cout << "Saved " << imgFileType << " file in experiment." << std::endl;
+                            LOG_INFO << "Saved " << imgFileType << " file in experiment.";
                         else
-                            std::cout << "ERROR: Couldn't save image ttc_lidar in experiment." << std::endl;
+                            LOG_ERROR << "Couldn't save image ttc_lidar in experiment.";
                         
                     }
 
                 } // eof TTC computation
                 else
                 {
-                    cout << "Lidar information insufficient - curr box = " << currBB->lidarPoints.size() << " pts, " << "prev box = " << prevBB->lidarPoints.size() << " pts. " << endl;
+                    LOG_INFO << "Lidar information insufficient - curr box = " << currBB->lidarPoints.count << " pts, " << "prev box = " << prevBB->lidarPoints.count << " pts. ";
                 }
-            } // eof loop over all BB matches            
+            } // eof loop over all BB match evaluations
 
         }
 
+        // release all transient per-frame buffers at once
+        FrameArenaStats arenaStats = frameArenaStats();
+        LOG_INFO << "#9 : FRAME ARENA - " << arenaStats.numAllocations << " allocations, " << arenaStats.bytesAllocated / 1024 << " kB, "
+                 << arenaStats.numBlockAllocations << " heap blocks (" << arenaStats.capacity / 1024 << " kB reserved)";
+        if (bAccountMemory) // heap allocations left in the stages whose scratch buffers come from the arena
+            LOG_INFO << "    heap allocations of cluster_lidar " << stageAllocations.frame()[STAGE_CLUSTER_LIDAR].numAllocations << ", track_boxes "
+                     << stageAllocations.frame()[STAGE_TRACK_BOXES].numAllocations << ", ttc " << stageAllocations.frame()[STAGE_TTC].numAllocations;
+        resetFrameArenas();
+
+        // heap allocations of each stage and the memory held by the buffered frames
+        measureMemory();
+        FrameFootprint footprint = frameFootprint(*(dataBuffer.end() - 1));
+        LOG_INFO << "#10 : MEMORY - " << frameAllocations.numAllocations << " allocations, " << frameAllocations.bytesAllocated / 1024 << " kB, frame holds "
+                 << footprint.total() / 1024 << " kB (image " << footprint.cameraImg / 1024 << ", products " << footprint.imgProducts / 1024
+                 << ", keypoints " << footprint.keypoints / 1024 << ", descriptors " << footprint.descriptors / 1024 << ", matches " << footprint.kptMatches / 1024
+                 << ", lidar " << footprint.lidarPoints / 1024 << ", depth " << footprint.lidarDepth / 1024 << ", boxes " << (footprint.boundingBoxes + footprint.boxIndex + footprint.bbMatches) / 1024
+                 << "), buffer " << bufferBytes / 1024 << " kB, resident " << residentBytes() / (1024 * 1024) << " MB (peak " << peakResidentBytes() / (1024 * 1024) << " MB)";
+        for (int stage = 0; bAccountMemory && stage < NUM_STAGES; ++stage)
+        {
+            const AllocationCounters &counters = stageAllocations.frame()[stage];
+            if (counters.numAllocations > 0)
+                LOG_INFO << "    " << stageNames[stage] << " : " << counters.numAllocations << " allocations, " << counters.bytesAllocated / 1024 << " kB";
+        }
+        stageAllocations.endFrame();
+
+        if (bStreaming)
+            stream->frameDone(captureTime);
+
+        frameTimer.lap(frameLatency);
+        framesProcessed->inc();
+        arenaCapacity->set((double)arenaStats.capacity);
+        frameBufferBytes->set((double)bufferBytes);
+        residentMemory->set((double)residentBytes());
+        if (bStreaming)
+            streamDropped->set(stream->stats().framesDropped);
+
     } // eof loop over all images
 
+    if (bDetectInCorridor && bCompareCorridorDetection && corridorFrames > 0)
+        LOG_INFO << "Corridor detection at " << corridorInputSize.width << "x" << corridorInputSize.height << " vs. full frame at 416x416 over " << corridorFrames << " frames: vehicle ahead found by both in "
+                 << corridorBoth << " (mean IoU " << corridorIoU / max(corridorBoth, 1) << "), corridor only " << corridorOnly << ", full frame only " << fullFrameOnly
+                 << "; detection " << corridorMs / corridorFrames << " ms vs. " << fullFrameMs / corridorFrames << " ms per frame";
+
+    if (bCompressDescriptors && bReportCompressionAccuracy && compressionAgreement.numCompressed > 0)
+        LOG_INFO << "Descriptor compression to " << compressedDims << " dimensions" << (rerankTopK > 0 ? ", re-ranking top " + to_string(rerankTopK) : string(""))
+                 << ": " << 100.0 * compressionAgreement.numAgreeing / compressionAgreement.numCompressed << " % of the matches agree, "
+                 << 100.0 * compressionAgreement.numAgreeing / max(compressionAgreement.numReference, 1) << " % of the full-descriptor matches found";
+
+    // memory of this detector/descriptor combination over the whole run
+    int numMeasuredFrames = max(stageAllocations.numFrames(), 1);
+    LOG_INFO << "Memory of " << detectorType << "_" << descriptorType << " over " << stageAllocations.numFrames() << " frames: buffer max "
+             << maxBufferBytes / 1024 << " kB, peak resident " << peakResidentBytes() / (1024 * 1024) << " MB, per frame";
+    for (int stage = 0; bAccountMemory && stage < NUM_STAGES; ++stage)
+    {
+        const AllocationCounters &counters = stageAllocations.run()[stage];
+        LOG_INFO << "    " << stageNames[stage] << " : " << counters.numAllocations / numMeasuredFrames << " allocations, "
+                 << counters.bytesAllocated / numMeasuredFrames / 1024 << " kB";
+    }
+
+    if (bStreaming)
+    {
+        StreamStats stats = stream->stats();
+        LOG_INFO << "Stream: " << stats.framesReceived << " frames received, " << stats.framesProcessed << " processed, " << stats.framesDropped << " dropped, "
+                 << stats.deadlineMisses << " deadline misses, latency avg " << (stats.framesProcessed > 0 ? stats.totalLatencyMs / stats.framesProcessed : 0.0)
+                 << " ms / max " << stats.maxLatencyMs << " ms";
+    }
+
     return 0;
 }
+
+
+// Learn the descriptor compression from the SIFT descriptors of the frames fromImgNo...upToImgNo of a KITTI sequence
+// (see descriptorCompression); these frames should not be among those the compression is evaluated on
+void trainDescriptorCompression(int dims, string sequence, int fromImgNo, int upToImgNo)
+{
+    string dataPath = "../";
+    int maxSamples = 200000; // descriptors used for the PCA
+    int imgStepWidth = max(1, (upToImgNo - fromImgNo) / 20); // samples from frames spread over the range
+
+    cv::Mat samples;
+    for (int imgNumber = fromImgNo; imgNumber <= upToImgNo && samples.rows < maxSamples; imgNumber += imgStepWidth)
+    {
+        SensorFrame sensorFrame;
+        loadKittiFrame(dataPath, sequence, imgNumber, sensorFrame);
+
+        cv::Mat imgGray;
+        cv::cvtColor(sensorFrame.cameraImg, imgGray, cv::COLOR_BGR2GRAY);
+        vector<cv::KeyPoint> keypoints;
+        detKeypoints(keypoints, imgGray, "SIFT", false, "");
+        cv::Mat descriptors;
+        descKeypoints(keypoints, imgGray, descriptors, "SIFT");
+
+        samples.push_back(descriptors);
+        LOG_INFO << "Sampled " << descriptors.rows << " descriptors from frame " << sensorFrame.imgFile;
+    }
+
+    DescriptorCompressor compressor;
+    if (trainDescriptorCompressor(samples, dims, compressor) && saveDescriptorCompressor(descriptorCompressionFile(dataPath, dims), compressor))
+        LOG_INFO << "Saved descriptor compression " << descriptorCompressionFile(dataPath, dims);
+}
+
+
+// Measure how the Lidar association, the box matching and the TTC estimation scale with the no. of Lidar points, objects
+// and keypoints, on synthetic frames with a known TTC. Each quantity is swept up to its maximum with the others at their
+// defaults; the times are the fastest of a few runs.
+void runSyntheticWorkload(int maxLidarPoints, int maxObjects, int maxKeypoints)
+{
+    cv::Mat P_rect_00, R_rect_00, RT;
+    kittiCalibration(P_rect_00, R_rect_00, RT);
+    ExperimentConfig config;
+    TaskPool ttcPool(2);
+    int numRuns = 3;
+
+    // the sweeps multiply their sizes, keep them far from int overflow (and from frames that don't fit into memory)
+    maxLidarPoints = min(maxLidarPoints, 64000000);
+    maxObjects = min(maxObjects, 4096);
+    maxKeypoints = min(maxKeypoints, 1000000);
+
+    // road corridor wide enough for all lanes of synthetic vehicles, the road surface and the walls are removed
+    float minX = 2.0, maxX = 80.0, maxY = 9.0, minZ = -1.5, maxZ = 0.0, minR = 0.1;
+
+    SyntheticWorkloadConfig base;
+    vector<SyntheticWorkloadConfig> loads;
+    for (int n = 1000; n <= maxLidarPoints; n *= 4)
+    {
+        loads.push_back(base);
+        loads.back().numLidarPoints = n;
+    }
+    for (int n = 1; n <= maxObjects; n *= 2)
+    {
+        loads.push_back(base);
+        loads.back().numObjects = n;
+    }
+    for (int n = 500; n <= maxKeypoints; n *= 2)
+    {
+        loads.push_back(base);
+        loads.back().numKeypoints = n;
+    }
+
+    LOG_INFO << "points, objects, keypoints, lidar_ms, match_boxes_ms, ttc_ms, boxes_matched, num_lidar_ttc, lidar_ttc_err, num_camera_ttc, camera_ttc_err";
+    for (const auto &load : loads)
+    {
+        double lidarMs = numeric_limits<double>::max(), matchBoxesMs = lidarMs, ttcMs = lidarMs;
+        int numMatchedCorrectly = 0, numLidarTTC = 0, numCameraTTC = 0;
+        double lidarError = 0.0, cameraError = 0.0; // mean relative error of the valid estimates
+        vector<SyntheticObject> objects;
+
+        for (int run = 0; run < numRuns; ++run)
+        {
+            DataFrame prevFrame, currFrame;
+            generateSyntheticFrames(load, P_rect_00, R_rect_00, RT, prevFrame, currFrame, objects);
+
+            double t = (double)cv::getTickCount();
+            for (DataFrame *frame : {&prevFrame, &currFrame})
+            {
+                cropLidarPoints(frame->lidarPoints, minX, maxX, maxY, minZ, maxZ, minR);
+                projectLidarToImage(frame->lidarDepth, frame->lidarPoints, load.imageSize, P_rect_00, R_rect_00, RT);
+                clusterLidarWithROI(frame->boundingBoxes, frame->lidarPoints, frame->boxLidarPointIdx, frame->lidarDepth, config.shrinkFactor);
+            }
+            lidarMs = min(lidarMs, 1000.0 * ((double)cv::getTickCount() - t) / cv::getTickFrequency());
+
+            t = (double)cv::getTickCount();
+            matchBoundingBoxes(currFrame.kptMatches, currFrame.bbMatches, prevFrame, currFrame);
+            matchBoxesMs = min(matchBoxesMs, 1000.0 * ((double)cv::getTickCount() - t) / cv::getTickFrequency());
+
+            vector<ObjectEvaluation> evaluations;
+            t = (double)cv::getTickCount();
+            evaluateObjects(prevFrame, currFrame, load.frameRate, ttcPool, evaluations, config.lidarNthPoint);
+            ttcMs = min(ttcMs, 1000.0 * ((double)cv::getTickCount() - t) / cv::getTickFrequency());
+
+            // the frames are the same in every run, so are the estimates
+            if (run == 0)
+            {
+                for (const auto &bbMatch : currFrame.bbMatches)
+                    numMatchedCorrectly += bbMatch.second == objects[bbMatch.first].currBoxID;
+
+                for (const auto &evaluation : evaluations)
+                {
+                    const BoundingBox &prevBB = prevFrame.boundingBoxes[evaluation.prevBoxIdx];
+                    const BoundingBox &currBB = currFrame.boundingBoxes[evaluation.currBoxIdx];
+                    if (objects[prevBB.boxID].currBoxID != currBB.boxID)
+                        continue; // TTC of a wrongly matched object has no ground truth
+
+                    double ttc = objects[prevBB.boxID].ttc;
+                    if (std::isfinite(evaluation.ttcLidar))
+                    {
+                        lidarError += fabs(evaluation.ttcLidar - ttc) / ttc;
+                        numLidarTTC++;
+                    }
+                    if (std::isfinite(evaluation.ttcCamera))
+                    {
+                        cameraError += fabs(evaluation.ttcCamera - ttc) / ttc;
+                        numCameraTTC++;
+                    }
+                }
+            }
+
+            resetFrameArenas();
+        }
+
+        LOG_INFO << load.numLidarPoints << ", " << objects.size() << ", " << load.numKeypoints << ", " << lidarMs << ", " << matchBoxesMs
+                 << ", " << ttcMs << ", " << numMatchedCorrectly << ", " << numLidarTTC << ", " << (numLidarTTC > 0 ? lidarError / numLidarTTC : NAN)
+                 << ", " << numCameraTTC << ", " << (numCameraTTC > 0 ? cameraError / numCameraTTC : NAN);
+    }
+}
@@ -0,0 +1,38 @@
+
+#include <new>
+#include <cstdlib>
+#include <malloc.h>
+
+#include "memoryAccounting.hpp"
+
+// Replacements of the global operator new and delete for the memory accounting. They are part of the executable only,
+// programs linking the camera_fusion library keep their own allocator. Both sides count the usable size of the block,
+// so that allocations and frees balance.
+void *operator new(std::size_t size)
+{
+    void *p = malloc(size > 0 ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    if (threadAllocationCounters)
+        countHeapAllocation(malloc_usable_size(p));
+    return p;
+}
+
+void *operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    if (!p)
+        return;
+    if (threadAllocationCounters)
+        countHeapFree(malloc_usable_size(p));
+    free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    ::operator delete(p);
+}
@@ -7,16 +7,30 @@
 #include <string>
 #include <opencv2/core.hpp>
 #include "dataStructures.h"
+#include "taskPool.hpp"
+#include "frameArena.hpp"
 
 
-void clusterLidarWithROI(std::vector<BoundingBox> &boundingBoxes, std::vector<LidarPoint> &lidarPoints, float shrinkFactor, cv::Mat &P_rect_xx, cv::Mat &R_rect_xx, cv::Mat &RT);
-void clusterKptMatchesWithROI(BoundingBox &boundingBox, std::vector<cv::KeyPoint> &kptsPrev, std::vector<cv::KeyPoint> &kptsCurr, std::vector<cv::DMatch> &kptMatches);
+void clusterLidarWithROI(std::vector<BoundingBox> &boundingBoxes, LidarPointCloud &lidarPoints, std::vector<int> &boxLidarPointIdx, float shrinkFactor,
+                         cv::Mat &P_rect_xx, cv::Mat &R_rect_xx, cv::Mat &RT);
+void clusterLidarWithROI(std::vector<BoundingBox> &boundingBoxes, LidarPointCloud &lidarPoints, std::vector<int> &boxLidarPointIdx,
+                         const LidarDepthImage &depthImg, float shrinkFactor);
+void clusterKptMatchesWithROI(BoundingBox &boundingBox, std::vector<cv::KeyPoint> &kptsPrev, std::vector<cv::KeyPoint> &kptsCurr, std::vector<cv::DMatch> &kptMatches,
+                              std::vector<int> &boxKptMatchIdx);
+// bbMatches map the boxID in the previous frame to the matched boxID in the current frame
 void matchBoundingBoxes(std::vector<cv::DMatch> &matches, std::map<int, int> &bbBestMatches, DataFrame &prevFrame, DataFrame &currFrame);
+void estimateBoxMotion(std::map<int, int> &bbMatches, DataFrame &prevFrame, DataFrame &currFrame);
+float propagateBoundingBoxes(std::vector<cv::DMatch> &matches, DataFrame &prevFrame, DataFrame &currFrame, int minMatches, std::map<int, int> &bbMatches);
+void buildBoxIndex(const std::vector<BoundingBox> &boundingBoxes, ArenaVector<int> &boxIndex);
+void evaluateObjects(DataFrame &prevFrame, DataFrame &currFrame, double frameRate, TaskPool &pool, std::vector<ObjectEvaluation> &evaluations,
+                     int lidarNthPoint=7);
 
-void show3DObjects(std::vector<BoundingBox> &boundingBoxes, cv::Size2f worldSize, cv::Size imageSize, bool bWait=true, std::string imgTitle="image.jpg");
+void show3DObjects(std::vector<BoundingBox> &boundingBoxes, LidarPointCloud &lidarPoints, std::vector<int> &boxLidarPointIdx, cv::Size2f worldSize, cv::Size imageSize,
+                   bool bWait=true, std::string imgTitle="image.jpg");
 
-void computeTTCCamera(std::vector<cv::KeyPoint> &kptsPrev, std::vector<cv::KeyPoint> &kptsCurr,
-                      std::vector<cv::DMatch> kptMatches, double frameRate, double &TTC, cv::Mat *visImg=nullptr);
-void computeTTCLidar(std::vector<LidarPoint> &lidarPointsPrev,
-                     std::vector<LidarPoint> &lidarPointsCurr, double frameRate, double &TTC);
+void computeTTCCamera(std::vector<cv::KeyPoint> &kptsPrev, std::vector<cv::KeyPoint> &kptsCurr, std::vector<cv::DMatch> &kptMatches,
+                      std::vector<int> &boxKptMatchIdx, IndexSpan boxKptMatches, double frameRate, double &TTC, cv::Mat *visImg=nullptr);
+void computeTTCLidar(LidarPointCloud &lidarPointsPrev, std::vector<int> &boxLidarPointIdxPrev, IndexSpan boxLidarPointsPrev,
+                     LidarPointCloud &lidarPointsCurr, std::vector<int> &boxLidarPointIdxCurr, IndexSpan boxLidarPointsCurr, double frameRate, double &TTC,
+                     int N=7);
 #endif /* camFusion_hpp */
@@ -1,6 +1,7 @@
 
 #include <iostream>
 #include <algorithm>
+#include <cmath>
 #include <numeric>
 #include <string>
 #include <utility>
@@ -11,24 +12,52 @@
 #include <opencv2/xfeatures2d.hpp>
 
 #include "camFusion.hpp"
+#include "lidarData.hpp"
 #include "dataStructures.h"
+#include "frameArena.hpp"
+#include "logger.hpp"
 
 using namespace std;
 
 
+// Store per-box member lists back to back in a frame-level array and let each box refer to its span
+static void layoutBoxMembers(ArenaVector<ArenaVector<int>> &membersPerBox, std::vector<int> &memberIdx, ArenaVector<IndexSpan> &spans)
+{
+    memberIdx.clear();
+    spans.resize(membersPerBox.size());
+    for (size_t i = 0; i < membersPerBox.size(); ++i)
+    {
+        spans[i].first = (int)memberIdx.size();
+        spans[i].count = (int)membersPerBox[i].size();
+        memberIdx.insert(memberIdx.end(), membersPerBox[i].begin(), membersPerBox[i].end());
+    }
+}
+
+static void layoutBoxLidarPoints(std::vector<BoundingBox> &boundingBoxes, ArenaVector<ArenaVector<int>> &pointsInBox, std::vector<int> &boxLidarPointIdx)
+{
+    ArenaVector<IndexSpan> spans;
+    layoutBoxMembers(pointsInBox, boxLidarPointIdx, spans);
+    for (size_t i = 0; i < boundingBoxes.size(); ++i)
+        boundingBoxes[i].lidarPoints = spans[i];
+}
+
+
 // Create groups of Lidar points whose projection into the camera falls into the same bounding box
-void clusterLidarWithROI(std::vector<BoundingBox> &boundingBoxes, std::vector<LidarPoint> &lidarPoints, float shrinkFactor, cv::Mat &P_rect_xx, cv::Mat &R_rect_xx, cv::Mat &RT)
+void clusterLidarWithROI(std::vector<BoundingBox> &boundingBoxes, LidarPointCloud &lidarPoints, std::vector<int> &boxLidarPointIdx, float shrinkFactor,
+                         cv::Mat &P_rect_xx, cv::Mat &R_rect_xx, cv::Mat &RT)
 {
     // loop over all Lidar points and associate them to a 2D bounding box
     cv::Mat X(4, 1, cv::DataType<double>::type);
     cv::Mat Y(3, 1, cv::DataType<double>::type);
+    ArenaVector<ArenaVector<int>> pointsInBox(boundingBoxes.size());
+    ArenaVector<vector<BoundingBox>::iterator> enclosingBoxes; // pointers to all bounding boxes which enclose the current Lidar point
 
-    for (auto it1 = lidarPoints.begin(); it1 != lidarPoints.end(); ++it1)
+    for (size_t i = 0; i < lidarPoints.size(); ++i)
     {
         // assemble vector for matrix-vector-multiplication
-        X.at<double>(0, 0) = it1->x;
-        X.at<double>(1, 0) = it1->y;
-        X.at<double>(2, 0) = it1->z;
+        X.at<double>(0, 0) = lidarPoints.x[i];
+        X.at<double>(1, 0) = lidarPoints.y[i];
+        X.at<double>(2, 0) = lidarPoints.z[i];
         X.at<double>(3, 0) = 1;
 
         // project Lidar point into camera
@@ -37,7 +66,7 @@ void clusterLidarWithROI(std::vector<BoundingBox> &boundingBoxes, std::vector<Li
         pt.x = Y.at<double>(0, 0) / Y.at<double>(0, 2); // pixel coordinates
         pt.y = Y.at<double>(1, 0) / Y.at<double>(0, 2);
 
-        vector<vector<BoundingBox>::iterator> enclosingBoxes; // pointers to all bounding boxes which enclose the current Lidar point
+        enclosingBoxes.clear();
         for (vector<BoundingBox>::iterator it2 = boundingBoxes.begin(); it2 != boundingBoxes.end(); ++it2)
         {
             // shrink current bounding box slightly to avoid having too many outlier points around the edges
@@ -59,15 +88,58 @@ void clusterLidarWithROI(std::vector<BoundingBox> &boundingBoxes, std::vector<Li
         if (enclosingBoxes.size() == 1)
         { 
             // add Lidar point to bounding box
-            enclosingBoxes[0]->lidarPoints.push_back(*it1);
+            pointsInBox[enclosingBoxes[0] - boundingBoxes.begin()].push_back((int)i);
         }
 
     } // eof loop over all Lidar points
+
+    layoutBoxLidarPoints(boundingBoxes, pointsInBox, boxLidarPointIdx);
 }
 
 
-void show3DObjects(std::vector<BoundingBox> &boundingBoxes, cv::Size2f worldSize, cv::Size imageSize, bool bWait, string imgTitle)
+// Same association as above, but based on the frame's sparse depth image so that only the pixels inside each ROI are visited
+void clusterLidarWithROI(std::vector<BoundingBox> &boundingBoxes, LidarPointCloud &lidarPoints, std::vector<int> &boxLidarPointIdx,
+                         const LidarDepthImage &depthImg, float shrinkFactor)
 {
+    ArenaVector<int> numEnclosingBoxes(lidarPoints.size(), 0);
+    ArenaVector<ArenaVector<int>> pointsInBox(boundingBoxes.size());
+    ArenaVector<int> entries;
+
+    for (size_t i = 0; i < boundingBoxes.size(); ++i)
+    {
+        // shrink current bounding box slightly to avoid having too many outlier points around the edges
+        cv::Rect smallerBox;
+        smallerBox.x = boundingBoxes[i].roi.x + shrinkFactor * boundingBoxes[i].roi.width / 2.0;
+        smallerBox.y = boundingBoxes[i].roi.y + shrinkFactor * boundingBoxes[i].roi.height / 2.0;
+        smallerBox.width = boundingBoxes[i].roi.width * (1 - shrinkFactor);
+        smallerBox.height = boundingBoxes[i].roi.height * (1 - shrinkFactor);
+
+        lidarPointsInROI(depthImg, smallerBox, entries);
+        for (int e : entries)
+        {
+            pointsInBox[i].push_back(depthImg.pointIdx[e]);
+            numEnclosingBoxes[depthImg.pointIdx[e]]++;
+        }
+    }
+
+    // only points enclosed by exactly one box are kept, in their original order
+    for (size_t i = 0; i < boundingBoxes.size(); ++i)
+    {
+        std::sort(pointsInBox[i].begin(), pointsInBox[i].end());
+        pointsInBox[i].erase(std::remove_if(pointsInBox[i].begin(), pointsInBox[i].end(), [&numEnclosingBoxes](int idx) { return numEnclosingBoxes[idx] != 1; }),
+                             pointsInBox[i].end());
+    }
+
+    layoutBoxLidarPoints(boundingBoxes, pointsInBox, boxLidarPointIdx);
+}
+
+
+void show3DObjects(std::vector<BoundingBox> &boundingBoxes, LidarPointCloud &lidarPoints, std::vector<int> &boxLidarPointIdx, cv::Size2f worldSize, cv::Size imageSize,
+                   bool bWait, string imgTitle)
+{
+    if (!bWait && imgTitle.empty()) // neither shown nor saved
+        return;
+
 	//to better visual lidar point top view, fix the starting world size as 6
 	const float START_HEIGHT = 6.8;
 	worldSize.height = worldSize.height - START_HEIGHT;
@@ -83,15 +155,16 @@ void show3DObjects(std::vector<BoundingBox> &boundingBoxes, cv::Size2f worldSize
         // plot Lidar points into top view image
         int top=1e8, left=1e8, bottom=0.0, right=0.0; 
         float xwmin=1e8, ywmin=1e8, ywmax=-1e8;
-        if(it1->lidarPoints.size() < 3){
+        if(it1->lidarPoints.count < 3){
         	//skip the bounding box display if it contains less than three points.
         	continue;
         }
-        for (auto it2 = it1->lidarPoints.begin(); it2 != it1->lidarPoints.end(); ++it2)
+        auto firstIdx = boxLidarPointIdx.begin() + it1->lidarPoints.first;
+        for (auto it2 = firstIdx; it2 != firstIdx + it1->lidarPoints.count; ++it2)
         {
             // world coordinates
-            float xw = (*it2).x; // world position in m with x facing forward from sensor
-            float yw = (*it2).y; // world position in m with y facing left from sensor
+            float xw = lidarPoints.x[*it2]; // world position in m with x facing forward from sensor
+            float yw = lidarPoints.y[*it2]; // world position in m with y facing left from sensor
             xwmin = xwmin<xw ? xwmin : xw;
             ywmin = ywmin<yw ? ywmin : yw;
             ywmax = ywmax>yw ? ywmax : yw;
@@ -114,11 +187,11 @@ void show3DObjects(std::vector<BoundingBox> &boundingBoxes, cv::Size2f worldSize
 
         // augment object with some key data
         char str1[200], str2[200];
-        sprintf(str1, "box id=%d, #pts=%d", it1->boxID, (int)it1->lidarPoints.size());
+        sprintf(str1, "box id=%d, #pts=%d", it1->boxID, it1->lidarPoints.count);
         putText(topviewImg, str1, cv::Point2f(left-250, bottom+50), cv::FONT_ITALIC, 1, currColor);
         sprintf(str2, "xmin=%2.2f m, yw=%2.2f m", xwmin, ywmax-ywmin);
         putText(topviewImg, str2, cv::Point2f(left-250, bottom+125), cv::FONT_ITALIC, 1, currColor);
-        cout<<"xmin="<<xwmin<<",yw="<<ywmax-ywmin<<",id="<<it1->boxID<<",pts="<<it1->lidarPoints.size()<<endl;
+        LOG_DEBUG << "xmin="<<xwmin<<",yw="<<ywmax-ywmin<<",id="<<it1->boxID<<",pts="<<it1->lidarPoints.count;
     }
 
     // plot distance markers
@@ -133,7 +206,7 @@ void show3DObjects(std::vector<BoundingBox> &boundingBoxes, cv::Size2f worldSize
 
     if(bWait)
     {
-        std::cout << "show3DObjects - press key to continue..." << std::endl;
+        LOG_INFO << "show3DObjects - press key to continue...";
     	// display image
 		string windowName = "3D Objects" + imgTitle;
 		cv::namedWindow(windowName, 1);
@@ -150,19 +223,19 @@ void show3DObjects(std::vector<BoundingBox> &boundingBoxes, cv::Size2f worldSize
         }
         catch (const cv::Exception& ex)
         {
-            std::cout << "Exception converting image in show3DObjects: " << ex.what() << std::endl;
+            LOG_ERROR << "Exception converting image in show3DObjects: " << ex.what();
         }
         if (result)
-            std::cout << "Saved " << fileName << " file in show3DObjects." << std::endl;
+            LOG_INFO << "Saved " << fileName << " file in show3DObjects.";
         else
-            std::cout << "ERROR: Couldn't save image in show3DObjects." << std::endl;
+            LOG_ERROR << "Couldn't save image in show3DObjects.";
     }
 }
 
 
 struct ExtendedDMatch
 {
-    cv::DMatch match;
+    int matchIdx; // position of the match in the frame's list of keypoint matches
     double euclideanDistance;
 };
 
@@ -172,32 +245,36 @@ bool Compare(ExtendedDMatch a, ExtendedDMatch b)
 }
 
 
-// Associate a given bounding box with the keypoints it contains
-void clusterKptMatchesWithROI(BoundingBox &boundingBox, std::vector<cv::KeyPoint> &kptsPrev, std::vector<cv::KeyPoint> &kptsCurr, std::vector<cv::DMatch> &kptMatches)
+// Associate a given bounding box with the keypoints it contains; the indices of the enclosed matches are appended
+// to the frame-level array boxKptMatchIdx and the box refers to them by its kptMatches span
+void clusterKptMatchesWithROI(BoundingBox &boundingBox, std::vector<cv::KeyPoint> &kptsPrev, std::vector<cv::KeyPoint> &kptsCurr, std::vector<cv::DMatch> &kptMatches,
+                              std::vector<int> &boxKptMatchIdx)
 {
-    std::vector<cv::DMatch> kptsROI;
-    std::vector<struct ExtendedDMatch> matchesWithDistances;
+    ArenaVector<struct ExtendedDMatch> matchesWithDistances;
 
-    for (auto match: kptMatches)
+    for (int i = 0; i < (int)kptMatches.size(); ++i)
     {
+        const cv::DMatch &match = kptMatches[i];
         bool keypointInBoundingBox = boundingBox.roi.contains(kptsCurr[match.trainIdx].pt) &&
-                                     boundingBox.roi.contains(kptsCurr[match.queryIdx].pt);
+                                     boundingBox.roi.contains(kptsPrev[match.queryIdx].pt);
 
         if(keypointInBoundingBox)
         {
-            cv::KeyPoint kpInnerCurr = kptsCurr.at(match.trainIdx);
-            cv::KeyPoint kpInnerPrev = kptsPrev.at(match.queryIdx);
+            const cv::KeyPoint &kpInnerCurr = kptsCurr.at(match.trainIdx);
+            const cv::KeyPoint &kpInnerPrev = kptsPrev.at(match.queryIdx);
             float eucDistBetwKpts = std::sqrt(std::pow((kpInnerCurr.pt.x - kpInnerPrev.pt.x),2)
                                              +std::pow((kpInnerCurr.pt.y - kpInnerPrev.pt.y),2));
 
             struct ExtendedDMatch m;
             m.euclideanDistance = eucDistBetwKpts;
-            m.match = match;
+            m.matchIdx = i;
             
             matchesWithDistances.push_back(m); 
         }
     }
 
+    boundingBox.kptMatches.first = (int)boxKptMatchIdx.size();
+
     if (matchesWithDistances.size() > 2)
     {
         std::sort(matchesWithDistances.begin(),matchesWithDistances.end(),Compare);
@@ -217,12 +294,12 @@ void clusterKptMatchesWithROI(BoundingBox &boundingBox, std::vector<cv::KeyPoint
             bool isOutlier = md->euclideanDistance < q1Distance-iqrDistance && md->euclideanDistance > q3Distance+iqrDistance;
             if(!isOutlier)
             {
-                kptsROI.push_back(md->match);
+                boxKptMatchIdx.push_back(md->matchIdx);
             }
         }
     }
-    
-    boundingBox.kptMatches = kptsROI;
+
+    boundingBox.kptMatches.count = (int)boxKptMatchIdx.size() - boundingBox.kptMatches.first;
 
 }
 
@@ -230,12 +307,15 @@ void clusterKptMatchesWithROI(BoundingBox &boundingBox, std::vector<cv::KeyPoint
 
 
 // Compute time-to-collision (TTC) based on keypoint correspondences in successive images
-void computeTTCCamera(std::vector<cv::KeyPoint> &kptsPrev, std::vector<cv::KeyPoint> &kptsCurr, 
-                      std::vector<cv::DMatch> kptMatches, double frameRate, double &TTC, cv::Mat *visImg)
+void computeTTCCamera(std::vector<cv::KeyPoint> &kptsPrev, std::vector<cv::KeyPoint> &kptsCurr, std::vector<cv::DMatch> &kptMatches,
+                      std::vector<int> &boxKptMatchIdx, IndexSpan boxKptMatches, double frameRate, double &TTC, cv::Mat *visImg)
 {
     double minDist = 100.0; // min. required distance
 
-    if (kptMatches.size() < 2)
+    auto matchesBegin = boxKptMatchIdx.begin() + boxKptMatches.first;
+    auto matchesEnd = matchesBegin + boxKptMatches.count;
+
+    if (boxKptMatches.count < 2)
     {
         TTC = NAN;
         return;
@@ -244,18 +324,19 @@ void computeTTCCamera(std::vector<cv::KeyPoint> &kptsPrev, std::vector<cv::KeyPo
     // We take two frames (current and previous) and two pairs of matched keypoints (firstMatch and secondMatch).
     // Compute distance ratios between all matched keypoints.
 
-    vector<double> distRatios; // stores the distance ratios for all keypoints between curr. and prev. frame
-    for (auto firstMatch = kptMatches.begin(); firstMatch != kptMatches.end() - 1; ++firstMatch) 
+    ArenaVector<double> distRatios; // stores the distance ratios for all keypoints between curr. and prev. frame
+    distRatios.reserve((size_t)(boxKptMatches.count - 1) * (boxKptMatches.count - 1)); // at most one ratio per (first, second) pair below
+    for (auto firstMatch = matchesBegin; firstMatch != matchesEnd - 1; ++firstMatch) 
     { 
         // get first keypoint and its matched partner in the prev. frame
-        cv::KeyPoint kpFirstCurrFrame = kptsCurr.at(firstMatch->trainIdx);
-        cv::KeyPoint kpFirstPrevFrame = kptsPrev.at(firstMatch->queryIdx);
+        const cv::KeyPoint &kpFirstCurrFrame = kptsCurr.at(kptMatches[*firstMatch].trainIdx);
+        const cv::KeyPoint &kpFirstPrevFrame = kptsPrev.at(kptMatches[*firstMatch].queryIdx);
 
-        for (auto secondMatch = kptMatches.begin() + 1; secondMatch != kptMatches.end(); ++secondMatch) 
+        for (auto secondMatch = matchesBegin + 1; secondMatch != matchesEnd; ++secondMatch) 
         {   
             // get second keypoint match
-            cv::KeyPoint kpSecondCurrFrame = kptsCurr.at(secondMatch->trainIdx);  
-            cv::KeyPoint kpSecondPrevFrame = kptsPrev.at(secondMatch->queryIdx);
+            const cv::KeyPoint &kpSecondCurrFrame = kptsCurr.at(kptMatches[*secondMatch].trainIdx);  
+            const cv::KeyPoint &kpSecondPrevFrame = kptsPrev.at(kptMatches[*secondMatch].queryIdx);
 
             // compute distances and distance ratios
             double distanceofKpsInCurrFrame = cv::norm(kpFirstCurrFrame.pt - kpSecondCurrFrame.pt);
@@ -294,42 +375,34 @@ void computeTTCCamera(std::vector<cv::KeyPoint> &kptsPrev, std::vector<cv::KeyPo
 
 
 
-double nthSmallestDistance(std::vector<LidarPoint> &lidarPoints, double N)
-// return the Nth smallest distance in x-direction of a collection of lidar points,
+double nthSmallestDistance(LidarPointCloud &lidarPoints, std::vector<int> &boxLidarPointIdx, IndexSpan boxLidarPoints, int N)
+// return the Nth smallest distance in x-direction of the lidar points of a box,
 // or the largest distance among n < N x-distances if there are no N distances.
 {
-	vector<double> nSmallestDistances;
+    // gather the x-coordinates of the box's points into a contiguous array
+    ArenaVector<float> distances(boxLidarPoints.count);
+    for (int i = 0; i < boxLidarPoints.count; ++i)
+        distances[i] = lidarPoints.x[boxLidarPointIdx[boxLidarPoints.first + i]];
 
-	for (auto lidarPoint = lidarPoints.begin(); lidarPoint != lidarPoints.end(); ++lidarPoint)
-	{
-        bool foundOneOfNSmallestDistances;
-        if (nSmallestDistances.size() == 0)
-            foundOneOfNSmallestDistances = true;
-        else
-            foundOneOfNSmallestDistances = lidarPoint->x < nSmallestDistances.back();
+    if (distances.empty())
+        return 0.0;
 
-        if (foundOneOfNSmallestDistances)
-        {
-            nSmallestDistances.push_back(lidarPoint->x);
-            std::sort(nSmallestDistances.begin(), nSmallestDistances.end());
-            if (nSmallestDistances.size() > N)
-                nSmallestDistances.pop_back();
-        }
-    }
+    int n = min(N, (int)distances.size());
+    std::nth_element(distances.begin(), distances.begin() + (n - 1), distances.end());
 
-    return nSmallestDistances.back();
+    return distances[n - 1];
 }
 
 
 
-void computeTTCLidar(std::vector<LidarPoint> &lidarPointsPrev,
-                     std::vector<LidarPoint> &lidarPointsCurr, double frameRate, double &TTC)
+void computeTTCLidar(LidarPointCloud &lidarPointsPrev, std::vector<int> &boxLidarPointIdxPrev, IndexSpan boxLidarPointsPrev,
+                     LidarPointCloud &lidarPointsCurr, std::vector<int> &boxLidarPointIdxCurr, IndexSpan boxLidarPointsCurr, double frameRate, double &TTC,
+                     int N)
 {
     double dT = 1/frameRate;        
-    const int N = 7;
 
-    double minXPrev = nthSmallestDistance(lidarPointsPrev, N);
-    double minXCurr = nthSmallestDistance(lidarPointsCurr, N);    
+    double minXPrev = nthSmallestDistance(lidarPointsPrev, boxLidarPointIdxPrev, boxLidarPointsPrev, N);
+    double minXCurr = nthSmallestDistance(lidarPointsCurr, boxLidarPointIdxCurr, boxLidarPointsCurr, N);    
 
     if ((minXPrev == 0 && minXCurr == 0) || (minXPrev == minXCurr))
         TTC = NAN;
@@ -340,24 +413,29 @@ void computeTTCLidar(std::vector<LidarPoint> &lidarPointsPrev,
 
 void matchBoundingBoxes(std::vector<cv::DMatch> &matches, std::map<int, int> &bbBestMatches, DataFrame &prevFrame, DataFrame &currFrame)
 {
-    map<int, map<int, int>> boxMatchings;       // the first key is a boxID in the current frame; the second key is a boxID in the prev frame.
-                                                // the value is the number of kp matches between both boxes. 
+    ArenaVector<int> prevBoxIndex, currBoxIndex;
+    buildBoxIndex(prevFrame.boundingBoxes, prevBoxIndex);
+    buildBoxIndex(currFrame.boundingBoxes, currBoxIndex);
+
+    // no. of kp matches between each pair of boxes; row = boxID in the current frame, column = boxID in the prev frame
+    int numPrevIDs = (int)prevBoxIndex.size(), numCurrIDs = (int)currBoxIndex.size();
+    ArenaVector<int> boxMatchings((size_t)numCurrIDs * numPrevIDs, 0);
 
-    for (auto match : matches)
+    for (const auto &match : matches)
     {
-        cv::KeyPoint prevKeypoint = prevFrame.keypoints[match.queryIdx];
-        cv::KeyPoint currKeypoint = currFrame.keypoints[match.trainIdx];
+        const cv::KeyPoint &prevKeypoint = prevFrame.keypoints[match.queryIdx];
+        const cv::KeyPoint &currKeypoint = currFrame.keypoints[match.trainIdx];
 
         int boxPrev = -1, boxCurr = -1;
 
-        for (auto box : prevFrame.boundingBoxes)
+        for (const auto &box : prevFrame.boundingBoxes)
             if(box.roi.contains(prevKeypoint.pt)) 
             {
                 boxPrev = box.boxID;
                 break;
             }
 
-        for (auto box : currFrame.boundingBoxes)
+        for (const auto &box : currFrame.boundingBoxes)
             if(box.roi.contains(currKeypoint.pt)) 
             {
                 boxCurr = box.boxID;
@@ -366,24 +444,210 @@ void matchBoundingBoxes(std::vector<cv::DMatch> &matches, std::map<int, int> &bb
 
         if (boxPrev == -1 || boxCurr == -1) continue;
 
-        bool foundFirstKpMatchForCurrBox = boxMatchings.find(boxCurr) == boxMatchings.end();
-        if (foundFirstKpMatchForCurrBox) 
+        boxMatchings[boxCurr * numPrevIDs + boxPrev]++;  // increase kp match count
+    }
+
+    // pairs are stored as (prev boxID, curr boxID); a prev box claimed by several current boxes stays with the one it shares
+    // most kp matches with
+    ArenaVector<int> claimedCount(numPrevIDs, 0);
+    for (int currBox = 0; currBox < numCurrIDs; ++currBox)
+    {
+        // the prev box with most kp matches, the lowest boxID wins a tie
+        int bestPrevBox = -1, bestCount = 0;
+        for (int prevBox = 0; prevBox < numPrevIDs; ++prevBox)
         {
-            map<int, int> a;
-            boxMatchings.insert(make_pair(boxCurr, a));
+            if (boxMatchings[currBox * numPrevIDs + prevBox] > bestCount)
+            {
+                bestCount = boxMatchings[currBox * numPrevIDs + prevBox];
+                bestPrevBox = prevBox;
+            }
         }
 
-        bool foundFirstKpMatchForPrevBox = boxMatchings[boxCurr].find(boxPrev) == boxMatchings[boxCurr].end();
-        if (foundFirstKpMatchForPrevBox)
-            boxMatchings[boxCurr].insert(make_pair(boxPrev, 0));
+        if (bestPrevBox >= 0 && bestCount > claimedCount[bestPrevBox])
+        {
+            claimedCount[bestPrevBox] = bestCount;
+            bbBestMatches[bestPrevBox] = currBox;
+        }
+    }
+}
+
+// Store how far each matched box has moved in the image since the previous frame (constant-velocity prior for guided matching)
+void estimateBoxMotion(std::map<int, int> &bbMatches, DataFrame &prevFrame, DataFrame &currFrame)
+{
+    ArenaVector<int> prevBoxIndex, currBoxIndex;
+    buildBoxIndex(prevFrame.boundingBoxes, prevBoxIndex);
+    buildBoxIndex(currFrame.boundingBoxes, currBoxIndex);
+
+    for (const auto &bbMatch : bbMatches)
+    {
+        int prevIdx = bbMatch.first < (int)prevBoxIndex.size() ? prevBoxIndex[bbMatch.first] : -1;
+        int currIdx = bbMatch.second < (int)currBoxIndex.size() ? currBoxIndex[bbMatch.second] : -1;
+        if (prevIdx < 0 || currIdx < 0)
+            continue;
+
+        const cv::Rect &prevRoi = prevFrame.boundingBoxes[prevIdx].roi;
+        const cv::Rect &currRoi = currFrame.boundingBoxes[currIdx].roi;
+        cv::Point2f prevCentre(prevRoi.x + 0.5f * prevRoi.width, prevRoi.y + 0.5f * prevRoi.height);
+        cv::Point2f currCentre(currRoi.x + 0.5f * currRoi.width, currRoi.y + 0.5f * currRoi.height);
+        currFrame.boundingBoxes[currIdx].motion = currCentre - prevCentre;
+    }
+}
+
+
+// Predict the current frame's boxes from the previous frame's boxes instead of running the object detector. Each box is shifted by the
+// median displacement and scaled by the median distance ratio of the keypoint matches starting inside it; boxID, class and confidence
+// are kept, so the box pairs in bbMatches are (boxID, boxID). A box with fewer than minMatches matches only follows its motion prior,
+// a box which has left the image is dropped. Returns the fraction of boxes supported by enough matches.
+float propagateBoundingBoxes(std::vector<cv::DMatch> &matches, DataFrame &prevFrame, DataFrame &currFrame, int minMatches, std::map<int, int> &bbMatches)
+{
+    const std::vector<BoundingBox> &prevBoxes = prevFrame.boundingBoxes;
+    cv::Rect imageRect(0, 0, currFrame.cameraImg.cols, currFrame.cameraImg.rows);
+
+    // matches grouped by the previous box containing their keypoint (first box wins, as in matchBoundingBoxes)
+    ArenaVector<ArenaVector<int>> matchesInBox(prevBoxes.size());
+    for (int i = 0; i < (int)matches.size(); ++i)
+    {
+        const cv::Point2f &prevPt = prevFrame.keypoints[matches[i].queryIdx].pt;
+        for (int b = 0; b < (int)prevBoxes.size(); ++b)
+            if (prevBoxes[b].roi.contains(prevPt))
+            {
+                matchesInBox[b].push_back(i);
+                break;
+            }
+    }
+
+    currFrame.boundingBoxes.clear();
+    bbMatches.clear();
+    int numSupported = 0;
+    const int maxPairMatches = 50; // distance ratios are computed over all pairs of at most this many matches per box
+
+    for (int b = 0; b < (int)prevBoxes.size(); ++b)
+    {
+        const BoundingBox &prevBox = prevBoxes[b];
+        const ArenaVector<int> &boxMatches = matchesInBox[b];
+
+        cv::Point2f shift = prevBox.motion; // constant-velocity fallback
+        double scale = 1.0;
+        bool bSupported = (int)boxMatches.size() >= max(minMatches, 1);
+        if (bSupported)
+        {
+            ArenaVector<float> dx(boxMatches.size()), dy(boxMatches.size());
+            for (size_t i = 0; i < boxMatches.size(); ++i)
+            {
+                const cv::DMatch &match = matches[boxMatches[i]];
+                cv::Point2f flow = currFrame.keypoints[match.trainIdx].pt - prevFrame.keypoints[match.queryIdx].pt;
+                dx[i] = flow.x;
+                dy[i] = flow.y;
+            }
+            size_t mid = dx.size() / 2;
+            std::nth_element(dx.begin(), dx.begin() + mid, dx.end());
+            std::nth_element(dy.begin(), dy.begin() + mid, dy.end());
+            shift = cv::Point2f(dx[mid], dy[mid]);
+
+            // scale change from the distance ratios of keypoint pairs which are not too close to each other
+            double minDist = 0.2 * min(prevBox.roi.width, prevBox.roi.height);
+            int numPairMatches = min((int)boxMatches.size(), maxPairMatches);
+            ArenaVector<double> distRatios;
+            for (int i = 0; i < numPairMatches; ++i)
+            {
+                const cv::DMatch &first = matches[boxMatches[i]];
+                for (int j = i + 1; j < numPairMatches; ++j)
+                {
+                    const cv::DMatch &second = matches[boxMatches[j]];
+                    double distPrev = cv::norm(prevFrame.keypoints[first.queryIdx].pt - prevFrame.keypoints[second.queryIdx].pt);
+                    double distCurr = cv::norm(currFrame.keypoints[first.trainIdx].pt - currFrame.keypoints[second.trainIdx].pt);
+                    if (distPrev >= minDist)
+                        distRatios.push_back(distCurr / distPrev);
+                }
+            }
+            if (!distRatios.empty())
+            {
+                std::nth_element(distRatios.begin(), distRatios.begin() + distRatios.size() / 2, distRatios.end());
+                scale = distRatios[distRatios.size() / 2];
+            }
+        }
 
-        boxMatchings[boxCurr][boxPrev]++;  // increase kp match count
+        cv::Point2f centre(prevBox.roi.x + 0.5f * prevBox.roi.width + shift.x, prevBox.roi.y + 0.5f * prevBox.roi.height + shift.y);
+        cv::Size2f size(prevBox.roi.width * scale, prevBox.roi.height * scale);
+        cv::Rect roi = cv::Rect(cv::Point(cvRound(centre.x - 0.5f * size.width), cvRound(centre.y - 0.5f * size.height)),
+                                cv::Size(cvRound(size.width), cvRound(size.height))) & imageRect;
+        if (roi.area() < 0.25 * size.width * size.height)
+            continue; // mostly outside the image
+
+        BoundingBox box = prevBox;
+        box.roi = roi;
+        box.motion = shift;
+        box.lidarPoints = box.kptMatches = IndexSpan();
+        currFrame.boundingBoxes.push_back(box);
+        bbMatches.insert(make_pair(box.boxID, box.boxID));
+
+        if (bSupported)
+            numSupported++;
     }
 
-    for(auto boxMatch : boxMatchings)
+    return prevBoxes.empty() ? 1.0f : (float)numSupported / prevBoxes.size();
+}
+
+
+// Direct lookup table from boxID to the position of the box in boundingBoxes (-1 for unused IDs)
+void buildBoxIndex(const std::vector<BoundingBox> &boundingBoxes, ArenaVector<int> &boxIndex)
+{
+    int maxBoxID = -1;
+    for (const auto &box : boundingBoxes)
+        maxBoxID = max(maxBoxID, box.boxID);
+
+    boxIndex.assign(maxBoxID + 1, -1);
+    for (int i = 0; i < (int)boundingBoxes.size(); ++i)
+        boxIndex[boundingBoxes[i].boxID] = i;
+}
+
+
+// Compute Lidar and camera TTC for all box pairs in currFrame.bbMatches. The pairs are evaluated in parallel on the
+// task pool; the results are returned in the order of bbMatches so the output does not depend on scheduling.
+void evaluateObjects(DataFrame &prevFrame, DataFrame &currFrame, double frameRate, TaskPool &pool, std::vector<ObjectEvaluation> &evaluations,
+                     int lidarNthPoint)
+{
+    ArenaVector<int> prevBoxIndex, currBoxIndex;
+    buildBoxIndex(prevFrame.boundingBoxes, prevBoxIndex);
+    buildBoxIndex(currFrame.boundingBoxes, currBoxIndex);
+
+    evaluations.clear();
+    for (const auto &bbMatch : currFrame.bbMatches)
     {
-        int currBox = boxMatch.first;
-        int bestPrevBox = max_element(boxMatch.second.begin(), boxMatch.second.end(), [] (const std::pair<int,int>& a, const std::pair<int,int>& b)->bool{ return a.second < b.second; })->first;
-        bbBestMatches.insert(make_pair(currBox, bestPrevBox));
+        // pairs are (prev boxID, curr boxID), see matchBoundingBoxes
+        ObjectEvaluation evaluation;
+        evaluation.prevBoxIdx = bbMatch.first < (int)prevBoxIndex.size() ? prevBoxIndex[bbMatch.first] : -1;
+        evaluation.currBoxIdx = bbMatch.second < (int)currBoxIndex.size() ? currBoxIndex[bbMatch.second] : -1;
+        if (evaluation.prevBoxIdx < 0 || evaluation.currBoxIdx < 0)
+            continue;
+
+        BoundingBox &prevBB = prevFrame.boundingBoxes[evaluation.prevBoxIdx];
+        BoundingBox &currBB = currFrame.boundingBoxes[evaluation.currBoxIdx];
+        evaluation.bLidarSufficient = currBB.lidarPoints.count > 0 && prevBB.lidarPoints.count > 0; // only compute TTC if we have Lidar points
+        evaluation.ttcLidar = evaluation.ttcCamera = NAN;
+
+        // appending to the frame-level match index array is done up front and in a fixed order
+        if (evaluation.bLidarSufficient)
+            clusterKptMatchesWithROI(currBB, prevFrame.keypoints, currFrame.keypoints, currFrame.kptMatches, currFrame.boxKptMatchIdx);
+
+        evaluations.push_back(evaluation);
     }
-}
\ No newline at end of file
+
+    // the TTC computations only read the frames and each task writes its own result; the task captures a single
+    // reference so that std::function stores it without a heap allocation
+    struct { DataFrame &prevFrame, &currFrame; double frameRate; int lidarNthPoint; std::vector<ObjectEvaluation> &evaluations; } ctx = { prevFrame, currFrame, frameRate, lidarNthPoint, evaluations };
+    pool.run((int)evaluations.size(), [&ctx](int i) {
+        DataFrame &prevFrame = ctx.prevFrame, &currFrame = ctx.currFrame;
+        double frameRate = ctx.frameRate;
+        ObjectEvaluation &evaluation = ctx.evaluations[i];
+        if (!evaluation.bLidarSufficient)
+            return;
+
+        const BoundingBox &prevBB = prevFrame.boundingBoxes[evaluation.prevBoxIdx];
+        const BoundingBox &currBB = currFrame.boundingBoxes[evaluation.currBoxIdx];
+
+        computeTTCLidar(prevFrame.lidarPoints, prevFrame.boxLidarPointIdx, prevBB.lidarPoints,
+                        currFrame.lidarPoints, currFrame.boxLidarPointIdx, currBB.lidarPoints, frameRate, evaluation.ttcLidar, ctx.lidarNthPoint);
+        computeTTCCamera(prevFrame.keypoints, currFrame.keypoints, currFrame.kptMatches, currFrame.boxKptMatchIdx, currBB.kptMatches, frameRate, evaluation.ttcCamera);
+    });
+}
@@ -4,13 +4,49 @@
 
 #include <vector>
 #include <map>
+#include <cstdint>
 #include <opencv2/core.hpp>
 
-struct LidarPoint { // single lidar point in space
-    double x,y,z,r; // x,y,z in [m], r is point reflectivity
+struct LidarPointCloud { // lidar points in space, stored as float32 structure of arrays (same precision as the Velodyne files)
+    std::vector<float> x,y,z,r; // x,y,z in [m], r is point reflectivity
+
+    size_t size() const { return x.size(); }
+    void resize(size_t n) { x.resize(n); y.resize(n); z.resize(n); r.resize(n); }
+};
+
+struct DetectorInputTransform { // maps the object detector's input image back to the camera image
+
+    cv::Rect roi; // region of the camera image the detector input has been taken from
+    float scaleX, scaleY; // detector input pixels per image pixel (equal if the aspect ratio is preserved)
+    cv::Point2f pad; // offset of the scaled region within the detector input (letterbox border)
 };
 
-struct BoundingBox { // bounding box around a classified object (contains both 2D and 3D data)
+struct FrameProducts { // preprocessed versions of a camera image, shared read-only by all pipeline stages
+
+    cv::Mat gray; // grayscale image used by keypoint detectors and descriptor extractors
+    std::vector<cv::Mat> pyramid; // optical flow pyramid of the grayscale image (only built in tracking mode)
+    cv::Size pyramidWinSize; // KLT window size the pyramid has been built for
+    int pyramidMaxLevel; // highest pyramid level (0-based)
+    cv::Mat detectorInput; // colour image (or region of it) resized to the object detector's input size
+    DetectorInputTransform detectorTransform; // how detectorInput relates to the camera image
+};
+
+struct LidarDepthImage { // Lidar points of one frame projected into the camera image, stored row by row (compressed sparse row layout)
+
+    cv::Size imageSize; // size of the camera image the points have been projected into
+    std::vector<int> rowStart; // entries of image row v are at positions [rowStart[v], rowStart[v+1])
+    std::vector<int> col; // image column of each entry, sorted within a row
+    std::vector<int> pointIdx; // index of the projected point in the frame's Lidar point cloud
+    std::vector<float> range; // distance in driving direction (x) in [m]
+};
+
+struct IndexSpan { // contiguous range of entries in one of the frame-level membership arrays of a DataFrame
+
+    int first = 0; // position of the first entry
+    int count = 0; // no. of entries, empty until the box's members are laid out
+};
+
+struct BoundingBox { // bounding box around a classified object (contains both 2D and 3D data), cheap to copy
     
     int boxID; // unique identifier for this bounding box
     
@@ -18,26 +54,51 @@ struct BoundingBox { // bounding box around a classified object (contains both 2
     int classID; // ID based on class file provided to YOLO framework
     double confidence; // classification trust
 
-    std::vector<LidarPoint> lidarPoints; // Lidar 3D points which project into 2D image roi
-    std::vector<cv::KeyPoint> keypoints; // keypoints enclosed by 2D roi
-    std::vector<cv::DMatch> kptMatches; // keypoint matches enclosed by 2D roi
+    IndexSpan lidarPoints; // Lidar 3D points which project into 2D image roi (span of DataFrame::boxLidarPointIdx)
+    IndexSpan kptMatches; // keypoint matches enclosed by 2D roi (span of DataFrame::boxKptMatchIdx)
+    cv::Point2f motion; // displacement of the roi centre since the matched box in the previous frame, in pixels
 };
 
 struct DataFrame { // represents the available sensor information at the same time instance
     
     cv::Mat cameraImg; // camera image
+    FrameProducts imgProducts; // images derived from cameraImg, computed once per frame
     
     std::vector<cv::KeyPoint> keypoints; // 2D keypoints within camera image
     cv::Mat descriptors; // keypoint descriptors
+    cv::Mat compressedDescriptors; // PCA-reduced int8 descriptors (only with descriptor compression)
     std::vector<cv::DMatch> kptMatches; // keypoint matches between previous and current frame
-    std::vector<LidarPoint> lidarPoints;
+    LidarPointCloud lidarPoints;
+    LidarDepthImage lidarDepth; // projection of lidarPoints into cameraImg
 
     std::vector<BoundingBox> boundingBoxes; // ROI around detected objects in 2D image coordinates
-    std::map<int,int> bbMatches; // bounding box matches between previous and current frame
+    std::vector<int> boxLidarPointIdx; // indices into lidarPoints, grouped by bounding box
+    std::vector<int> boxKptMatchIdx; // indices into kptMatches, grouped by bounding box
+    std::map<int,int> bbMatches; // bounding box matches, boxID in the previous frame -> boxID in the current frame
     std::string imgFile;
 };
 
 
+struct ObjectEvaluation { // TTC estimates for one pair of bounding boxes matched between the previous and the current frame
+
+    int prevBoxIdx; // position of the box in the previous frame's boundingBoxes
+    int currBoxIdx; // position of the box in the current frame's boundingBoxes
+    bool bLidarSufficient; // both boxes contain Lidar points, otherwise no TTC has been computed
+    double ttcLidar, ttcCamera; // time-to-collision in [s]
+};
+
+
+struct ExperimentConfig { // tunable thresholds and output of an experiment, the defaults are the hand-picked values
+
+    int fastThreshold = 30; // FAST detector: min. intensity difference between the centre and the circle pixels
+    float maxDescDistRatio = 0.8; // ratio test of the descriptor matching (SEL_KNN)
+    float shrinkFactor = 0.10; // bounding boxes are shrunk by this fraction before Lidar points are associated
+    int lidarNthPoint = 7; // Lidar TTC uses the distance of the Nth closest point of a box
+    float confThreshold = 0.2; // min. confidence of object detections
+    bool bWriteImages = true; // save the visualizations of each frame to the working directory
+};
+
+
 struct ExperimentResult
 {
     std::string detectorType;
@@ -48,6 +109,9 @@ struct ExperimentResult
     int numOfKeypointsDetected;
     int numOfKeypointsMatched;
     double processingTime;
+    size_t frameBufferBytes; // memory held by the buffered frames (see frameFootprint)
+    uint64_t numAllocations, bytesAllocated; // heap allocations of all stages of the frame
+    size_t peakResidentBytes; // peak resident set size of the process so far
 };
 
 #endif /* dataStructures_h */
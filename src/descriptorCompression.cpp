@@ -0,0 +1,231 @@
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#include "descriptorCompression.hpp"
+#include "matchingKernels.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+
+std::string descriptorCompressionFile(std::string dataPath, int dims)
+{
+    return dataPath + "dat/descriptor_pca" + to_string(dims) + ".yml";
+}
+
+
+// Learn the projection onto the first dims principal components of the sample descriptors (one per row) and a
+// quantization scale which maps 99.9 % of the projected components into the int8 range
+bool trainDescriptorCompressor(const cv::Mat &samples, int dims, DescriptorCompressor &compressor)
+{
+    if (samples.rows < dims || dims > samples.cols || samples.depth() != CV_32F)
+    {
+        LOG_ERROR << "Need at least " << dims << " float descriptors of more than " << dims << " dimensions to train the compression";
+        return false;
+    }
+
+    cv::PCA pca(samples, cv::Mat(), cv::PCA::DATA_AS_ROW, dims);
+    compressor.mean = pca.mean.clone();
+    compressor.projection = pca.eigenvectors.clone();
+    compressor.scale = 1.0;
+
+    cv::Mat projected = pca.project(samples);
+    vector<float> magnitudes;
+    magnitudes.reserve(projected.total());
+    for (int r = 0; r < projected.rows; ++r)
+    {
+        const float *row = projected.ptr<float>(r);
+        for (int c = 0; c < projected.cols; ++c)
+            magnitudes.push_back(std::fabs(row[c]));
+    }
+    if (magnitudes.empty())
+        return false;
+
+    auto percentile = magnitudes.begin() + (size_t)(0.999 * (magnitudes.size() - 1));
+    nth_element(magnitudes.begin(), percentile, magnitudes.end());
+    compressor.scale = *percentile > 0 ? 127.0f / *percentile : 1.0f;
+
+    LOG_INFO << "Trained descriptor compression " << samples.cols << " -> " << dims << " dimensions from " << samples.rows << " descriptors";
+    return true;
+}
+
+
+bool saveDescriptorCompressor(std::string fileName, const DescriptorCompressor &compressor)
+{
+    cv::FileStorage fs(fileName, cv::FileStorage::WRITE);
+    if (!fs.isOpened())
+    {
+        LOG_ERROR << "Couldn't write descriptor compression " << fileName;
+        return false;
+    }
+    fs << "mean" << compressor.mean;
+    fs << "projection" << compressor.projection;
+    fs << "scale" << compressor.scale;
+    return true;
+}
+
+
+bool loadDescriptorCompressor(std::string fileName, DescriptorCompressor &compressor)
+{
+    cv::FileStorage fs(fileName, cv::FileStorage::READ);
+    if (!fs.isOpened())
+    {
+        LOG_ERROR << "Couldn't open descriptor compression " << fileName;
+        return false;
+    }
+    fs["mean"] >> compressor.mean;
+    fs["projection"] >> compressor.projection;
+    fs["scale"] >> compressor.scale;
+
+    bool bValid = !compressor.projection.empty() && compressor.mean.cols == compressor.projection.cols;
+    if (!bValid)
+        LOG_ERROR << fileName << " is not a valid descriptor compression";
+    return bValid;
+}
+
+
+// Project the descriptors (one per row) and quantize them to int8; returns the processing time in ms
+float compressDescriptors(const DescriptorCompressor &compressor, const cv::Mat &descriptors, cv::Mat &compressed)
+{
+    double t = (double)cv::getTickCount();
+    int dims = compressor.dims(), cols = compressor.projection.cols;
+    compressed.create(descriptors.rows, dims, CV_8S);
+
+    vector<float> centered(cols);
+    const float *mean = compressor.mean.ptr<float>(0);
+    for (int r = 0; r < descriptors.rows; ++r)
+    {
+        const float *desc = descriptors.ptr<float>(r);
+        for (int c = 0; c < cols; ++c)
+            centered[c] = desc[c] - mean[c];
+
+        int8_t *out = compressed.ptr<int8_t>(r);
+        for (int k = 0; k < dims; ++k)
+        {
+            const float *component = compressor.projection.ptr<float>(k);
+            float dot = 0.0;
+            for (int c = 0; c < cols; ++c)
+                dot += centered[c] * component[c];
+
+            float q = std::round(compressor.scale * dot);
+            out[k] = (int8_t)std::max(-127.0f, std::min(127.0f, q));
+        }
+    }
+
+    return 1000.0 * ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+}
+
+
+static inline float fullL2Distance(const float *a, const float *b, int cols)
+{
+    float sum = 0.0;
+    for (int c = 0; c < cols; ++c)
+    {
+        float d = a[c] - b[c];
+        sum += d * d;
+    }
+    return std::sqrt(sum);
+}
+
+
+// Keep the topK reference descriptors closest in compressed space, then decide between them on the full descriptors
+template <int NumDims>
+static void matchReranked(const cv::Mat &compSource, const cv::Mat &compRef, const cv::Mat &descSource, const cv::Mat &descRef,
+                          int topK, float maxDistRatio, std::vector<cv::DMatch> &matches)
+{
+    vector<float> candDist(topK);
+    vector<int> candIdx(topK);
+
+    matches.clear();
+    for (int q = 0; q < compSource.rows; ++q)
+    {
+        const int8_t *query = compSource.ptr<int8_t>(q);
+        int numCand = 0;
+
+        // insertion into a short sorted list is cheaper than a heap for the small topK used here
+        for (int t = 0; t < compRef.rows; ++t)
+        {
+            float dist = QuantizedL2Distance<NumDims>::distance(query, compRef.ptr<int8_t>(t));
+            if (numCand == topK && dist >= candDist[topK - 1])
+                continue;
+
+            int pos = numCand < topK ? numCand++ : topK - 1;
+            while (pos > 0 && candDist[pos - 1] > dist)
+            {
+                candDist[pos] = candDist[pos - 1];
+                candIdx[pos] = candIdx[pos - 1];
+                pos--;
+            }
+            candDist[pos] = dist;
+            candIdx[pos] = t;
+        }
+
+        float bestDist = numeric_limits<float>::max(), secondDist = bestDist;
+        int bestIdx = -1;
+        for (int k = 0; k < numCand; ++k)
+        {
+            float dist = fullL2Distance(descSource.ptr<float>(q), descRef.ptr<float>(candIdx[k]), descSource.cols);
+            if (dist < bestDist)
+            {
+                secondDist = bestDist;
+                bestDist = dist;
+                bestIdx = candIdx[k];
+            }
+            else if (dist < secondDist)
+            {
+                secondDist = dist;
+            }
+        }
+
+        bool bDistinctive = maxDistRatio <= 0.0 || bestDist < maxDistRatio * secondDist;
+        if (bestIdx >= 0 && bDistinctive)
+            matches.push_back(cv::DMatch(q, bestIdx, bestDist));
+    }
+}
+
+
+// Match compressed source against reference descriptors and re-rank the topK (>= 2) candidates of each source descriptor
+// with the full descriptors; returns the processing time in ms or -1 if there is no kernel for the compressed layout
+float matchCompressedReranked(const cv::Mat &compSource, const cv::Mat &compRef, const cv::Mat &descSource, const cv::Mat &descRef,
+                              int topK, float maxDistRatio, std::vector<cv::DMatch> &matches)
+{
+    if (compSource.cols != compRef.cols || descSource.rows != compSource.rows || descRef.rows != compRef.rows ||
+        descSource.depth() != CV_32F || descRef.depth() != CV_32F)
+        return -1.0;
+
+    double t = (double)cv::getTickCount();
+    topK = max(topK, 2); // the ratio test needs the second best
+    if (compSource.cols == 32)
+        matchReranked<32>(compSource, compRef, descSource, descRef, topK, maxDistRatio, matches);
+    else if (compSource.cols == 64)
+        matchReranked<64>(compSource, compRef, descSource, descRef, topK, maxDistRatio, matches);
+    else
+        return -1.0;
+    float period = 1000.0 * ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+    LOG_DEBUG << "Compressed matching of " << compSource.rows << " x " << compRef.rows << " descriptors, re-ranking top " << topK << ", in " << period << " ms";
+    return period;
+}
+
+
+MatchAgreement compareMatches(const std::vector<cv::DMatch> &reference, const std::vector<cv::DMatch> &compressed)
+{
+    MatchAgreement agreement{(int)reference.size(), (int)compressed.size(), 0};
+
+    int maxQuery = -1;
+    for (const auto &match : reference)
+        maxQuery = max(maxQuery, match.queryIdx);
+    vector<int> referenceTrain(maxQuery + 1, -1);
+    for (const auto &match : reference)
+        referenceTrain[match.queryIdx] = match.trainIdx;
+
+    for (const auto &match : compressed)
+    {
+        if (match.queryIdx <= maxQuery && referenceTrain[match.queryIdx] == match.trainIdx)
+            agreement.numAgreeing++;
+    }
+    return agreement;
+}
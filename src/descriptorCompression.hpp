@@ -0,0 +1,39 @@
+
+#ifndef descriptorCompression_hpp
+#define descriptorCompression_hpp
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+#include <opencv2/core.hpp>
+
+// Compression of float descriptors (SIFT) for matching : a PCA projection learned offline from sample descriptors
+// reduces them to 32 or 64 dimensions, which are then quantized to int8.
+struct DescriptorCompressor {
+
+    cv::Mat mean; // 1 x D mean of the training descriptors, CV_32F
+    cv::Mat projection; // d x D principal components as rows, CV_32F
+    float scale; // compressed = round(scale * projected), clamped to [-127, 127]
+
+    int dims() const { return projection.rows; }
+    bool empty() const { return projection.empty(); }
+};
+
+struct MatchAgreement { // compressed matching compared with matching the uncompressed descriptors
+
+    int numReference; // matches of the uncompressed descriptors
+    int numCompressed; // matches of the compressed descriptors
+    int numAgreeing; // compressed matches which pair the same keypoints as a reference match
+};
+
+std::string descriptorCompressionFile(std::string dataPath, int dims); // where the projection to dims dimensions is stored
+bool trainDescriptorCompressor(const cv::Mat &samples, int dims, DescriptorCompressor &compressor);
+bool saveDescriptorCompressor(std::string fileName, const DescriptorCompressor &compressor);
+bool loadDescriptorCompressor(std::string fileName, DescriptorCompressor &compressor);
+
+float compressDescriptors(const DescriptorCompressor &compressor, const cv::Mat &descriptors, cv::Mat &compressed);
+float matchCompressedReranked(const cv::Mat &compSource, const cv::Mat &compRef, const cv::Mat &descSource, const cv::Mat &descRef,
+                              int topK, float maxDistRatio, std::vector<cv::DMatch> &matches);
+MatchAgreement compareMatches(const std::vector<cv::DMatch> &reference, const std::vector<cv::DMatch> &compressed);
+
+#endif /* descriptorCompression_hpp */
@@ -0,0 +1,47 @@
+
+#include <iostream>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+
+#include "detectorModel.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+// The network of the given model files, loaded on first use and kept for the lifetime of the process. OpenCV copies the weights
+// into the layers while parsing, so the files are read with the reader of the dnn module.
+DetectorModel &loadDetectorModel(std::string classesFile, std::string modelConfiguration, std::string modelWeights)
+{
+    static mutex modelsMutex;
+    static map<string, unique_ptr<DetectorModel>> models;
+
+    lock_guard<mutex> lock(modelsMutex);
+    unique_ptr<DetectorModel> &model = models[modelWeights];
+    if (model)
+        return *model;
+
+    double t = (double)cv::getTickCount();
+    model.reset(new DetectorModel);
+    model->net = cv::dnn::readNetFromDarknet(modelConfiguration, modelWeights);
+
+    ifstream ifs(classesFile.c_str());
+    string line;
+    while (getline(ifs, line)) model->classes.push_back(line);
+
+    model->net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
+    model->net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+
+    // Get names of output layers
+    vector<int> outLayers = model->net.getUnconnectedOutLayers(); // get  indices of  output layers, i.e.  layers with unconnected outputs
+    vector<cv::String> layersNames = model->net.getLayerNames(); // get  names of all layers in the network
+    for (size_t i = 0; i < outLayers.size(); ++i)
+        model->outputNames.push_back(layersNames[outLayers[i] - 1]);
+
+    model->loadTime = 1000.0 * ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    model->bForwarded = false;
+    LOG_INFO << "Loaded detector model from " << modelWeights << " in " << model->loadTime << " ms";
+
+    return *model;
+}
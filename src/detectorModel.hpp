@@ -0,0 +1,26 @@
+
+#ifndef detectorModel_hpp
+#define detectorModel_hpp
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <opencv2/core.hpp>
+#include <opencv2/dnn.hpp>
+
+// A detector network which is loaded once per process and shared by all callers, together with everything
+// derived from it that detectObjects would otherwise recompute on every frame
+struct DetectorModel {
+
+    cv::dnn::Net net;
+    std::vector<std::string> classes; // class names by class id
+    std::vector<cv::String> outputNames; // names of the unconnected output layers
+    std::mutex forwardMutex; // cv::dnn::Net is not reentrant, concurrent callers take turns
+    double loadTime; // ms spent building the network
+    bool bForwarded; // the first forward pass has run (guarded by forwardMutex)
+};
+
+DetectorModel &loadDetectorModel(std::string classesFile, std::string modelConfiguration, std::string modelWeights);
+
+#endif /* detectorModel_hpp */
@@ -0,0 +1,174 @@
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <algorithm>
+#include <mutex>
+#include <new>
+
+#include "frameArena.hpp"
+
+using namespace std;
+
+
+FrameArena::FrameArena(size_t blockSize)
+    : blockSize(blockSize), currentBlock(0), offset(0)
+{
+    memset(&counters, 0, sizeof(counters));
+}
+
+
+FrameArena::~FrameArena()
+{
+    for (auto &block : blocks)
+        free(block.data);
+}
+
+
+void *FrameArena::allocate(size_t numBytes, size_t alignment)
+{
+    counters.numAllocations++;
+
+    while (true)
+    {
+        if (currentBlock < blocks.size())
+        {
+            Block &block = blocks[currentBlock];
+            uintptr_t base = (uintptr_t)block.data;
+            size_t alignedOffset = ((base + offset + alignment - 1) & ~(uintptr_t)(alignment - 1)) - base;
+            if (alignedOffset + numBytes <= block.size)
+            {
+                counters.bytesAllocated += alignedOffset + numBytes - offset;
+                offset = alignedOffset + numBytes;
+                return block.data + alignedOffset;
+            }
+
+            // continue in a later block kept from an earlier frame, the ones too small for this request are skipped for
+            // the rest of the frame only
+            size_t next = currentBlock + 1;
+            while (next < blocks.size() && blocks[next].size < numBytes + alignment)
+                next++;
+            if (next < blocks.size())
+            {
+                currentBlock = next;
+                offset = 0;
+                continue;
+            }
+        }
+
+        // the arena is growing: append a block large enough for this request, so that the blocks are walked in the same
+        // order every frame
+        Block block;
+        block.size = max(blockSize, numBytes + alignment);
+        block.data = (char *)malloc(block.size);
+        if (block.data == nullptr)
+            throw bad_alloc();
+        counters.numBlockAllocations++;
+        counters.capacity += block.size;
+
+        blocks.push_back(block);
+        currentBlock = blocks.size() - 1;
+        offset = 0;
+    }
+}
+
+
+void FrameArena::reset()
+{
+    currentBlock = 0;
+    offset = 0;
+
+    size_t capacity = counters.capacity;
+    memset(&counters, 0, sizeof(counters));
+    counters.capacity = capacity;
+}
+
+
+// per-thread arenas, registered so they can be reset and inspected from the main thread
+struct ThreadArena;
+static mutex arenaRegistryMutex;
+static vector<ThreadArena *> arenaRegistry;
+
+struct ThreadArena
+{
+    FrameArena arena;
+    thread::id owner;
+
+    ThreadArena() : owner(this_thread::get_id())
+    {
+        lock_guard<mutex> lock(arenaRegistryMutex);
+        arenaRegistry.push_back(this);
+    }
+
+    ~ThreadArena()
+    {
+        lock_guard<mutex> lock(arenaRegistryMutex);
+        arenaRegistry.erase(remove(arenaRegistry.begin(), arenaRegistry.end(), this), arenaRegistry.end());
+    }
+};
+
+
+FrameArena &frameArena()
+{
+    thread_local ThreadArena threadArena;
+    return threadArena.arena;
+}
+
+
+static bool ownedBy(const ThreadArena *threadArena, const std::vector<std::thread::id> *threads)
+{
+    return threads == nullptr || find(threads->begin(), threads->end(), threadArena->owner) != threads->end();
+}
+
+
+static void resetArenas(const std::vector<std::thread::id> *threads)
+{
+    lock_guard<mutex> lock(arenaRegistryMutex);
+    for (auto threadArena : arenaRegistry)
+        if (ownedBy(threadArena, threads))
+            threadArena->arena.reset();
+}
+
+
+void resetFrameArenas()
+{
+    resetArenas(nullptr);
+}
+
+
+void resetFrameArenas(const std::vector<std::thread::id> &threads)
+{
+    resetArenas(&threads);
+}
+
+
+static FrameArenaStats sumArenaStats(const std::vector<std::thread::id> *threads)
+{
+    FrameArenaStats total;
+    memset(&total, 0, sizeof(total));
+
+    lock_guard<mutex> lock(arenaRegistryMutex);
+    for (auto threadArena : arenaRegistry)
+    {
+        if (!ownedBy(threadArena, threads))
+            continue;
+        FrameArenaStats stats = threadArena->arena.stats();
+        total.numAllocations += stats.numAllocations;
+        total.bytesAllocated += stats.bytesAllocated;
+        total.numBlockAllocations += stats.numBlockAllocations;
+        total.capacity += stats.capacity;
+    }
+    return total;
+}
+
+
+FrameArenaStats frameArenaStats()
+{
+    return sumArenaStats(nullptr);
+}
+
+
+FrameArenaStats frameArenaStats(const std::vector<std::thread::id> &threads)
+{
+    return sumArenaStats(&threads);
+}
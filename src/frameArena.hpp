@@ -0,0 +1,70 @@
+
+#ifndef frameArena_hpp
+#define frameArena_hpp
+
+#include <stdio.h>
+#include <cstddef>
+#include <vector>
+#include <thread>
+
+struct FrameArenaStats { // allocation counters since the last reset
+
+    size_t numAllocations; // allocations served from the arena
+    size_t bytesAllocated; // bytes handed out (including alignment padding)
+    size_t numBlockAllocations; // blocks requested from the system heap (zero in steady state)
+    size_t capacity; // total size of the blocks owned by the arena
+};
+
+// Bump allocator for short-lived per-frame buffers. Memory is handed out from large blocks and only released
+// as a whole by reset(), which rewinds to the first block in O(1) and keeps the blocks for the next frame.
+class FrameArena
+{
+public:
+    explicit FrameArena(size_t blockSize = 1 << 20);
+    ~FrameArena();
+
+    void *allocate(size_t numBytes, size_t alignment);
+    void reset();
+    FrameArenaStats stats() const { return counters; }
+
+private:
+    struct Block { char *data; size_t size; };
+
+    std::vector<Block> blocks;
+    size_t blockSize; // default size of a new block
+    size_t currentBlock; // block allocations are currently served from
+    size_t offset; // first free byte in the current block
+    FrameArenaStats counters;
+};
+
+FrameArena &frameArena(); // arena of the calling thread
+void resetFrameArenas(); // reset the arenas of all threads (only while no per-frame work is running)
+void resetFrameArenas(const std::vector<std::thread::id> &threads); // reset the arenas of the given threads only
+FrameArenaStats frameArenaStats(); // counters summed over the arenas of all threads
+FrameArenaStats frameArenaStats(const std::vector<std::thread::id> &threads); // counters summed over the arenas of the given threads
+
+// STL allocator drawing from the calling thread's frame arena; deallocation is a no-op, so containers using it
+// must not outlive the frame
+template <class T>
+struct ArenaAllocator
+{
+    typedef T value_type;
+
+    FrameArena *arena;
+
+    ArenaAllocator() : arena(&frameArena()) {}
+    template <class U> ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t n) { return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T *, size_t) {}
+};
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena == b.arena; }
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena != b.arena; }
+
+template <class T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+#endif /* frameArena_hpp */
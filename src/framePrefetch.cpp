@@ -0,0 +1,81 @@
+
+#include <iostream>
+#include <utility>
+
+#include "framePrefetch.hpp"
+
+using namespace std;
+
+
+FramePrefetcher::FramePrefetcher(FrameLoader loader, int numFrames, int depth, int numThreads)
+    : loader(loader), numFrames(numFrames), depth(max(depth, 1)), nextToLoad(0), nextToConsume(0), bStop(false), stallTimeMs(0.0)
+{
+    for (int i = 0; i < max(numThreads, 1); ++i)
+        loaderThreads.push_back(thread(&FramePrefetcher::loadFrames, this));
+}
+
+
+FramePrefetcher::~FramePrefetcher()
+{
+    {
+        lock_guard<mutex> lock(mtx);
+        bStop = true;
+    }
+    loaderCondition.notify_all();
+
+    for (auto &t : loaderThreads)
+        t.join();
+}
+
+
+// Loader thread: claim the next frame position as long as the queue of ready frames is not full
+void FramePrefetcher::loadFrames()
+{
+    unique_lock<mutex> lock(mtx);
+    while (true)
+    {
+        loaderCondition.wait(lock, [this] { return bStop || nextToLoad >= numFrames || nextToLoad < nextToConsume + depth; });
+        if (bStop || nextToLoad >= numFrames)
+            return;
+
+        int position = nextToLoad++;
+
+        // decode without holding the lock so that several frames can be loaded concurrently
+        lock.unlock();
+        SensorFrame frame;
+        frame.index = position;
+        loader(position, frame);
+        lock.lock();
+
+        readyFrames[position] = std::move(frame);
+        consumerCondition.notify_all();
+    }
+}
+
+
+bool FramePrefetcher::next(SensorFrame &frame)
+{
+    unique_lock<mutex> lock(mtx);
+    if (nextToConsume >= numFrames)
+        return false;
+
+    double t = (double)cv::getTickCount();
+    consumerCondition.wait(lock, [this] { return readyFrames.count(nextToConsume) > 0; });
+    stallTimeMs += 1000.0 * ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+    auto it = readyFrames.find(nextToConsume);
+    frame = std::move(it->second);
+    readyFrames.erase(it);
+    nextToConsume++;
+
+    lock.unlock();
+    loaderCondition.notify_all();
+    return true;
+}
+
+
+int FramePrefetcher::queueDepth()
+{
+    lock_guard<mutex> lock(mtx);
+    return (int)readyFrames.size();
+}
@@ -0,0 +1,55 @@
+
+#ifndef framePrefetch_hpp
+#define framePrefetch_hpp
+
+#include <stdio.h>
+#include <vector>
+#include <map>
+#include <string>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <opencv2/core.hpp>
+
+#include "dataStructures.h"
+
+struct SensorFrame { // raw sensor data of one time instance as loaded from disk
+
+    int index; // position of the frame in the replayed sequence
+    std::string imgFile; // frame number used to name output files
+    std::string imgFullFilename; // file the camera image has been loaded from
+    cv::Mat cameraImg; // decoded camera image
+    LidarPointCloud lidarPoints; // uncropped Lidar scan
+};
+
+// Loads frames on background threads ahead of the consumer and hands them out in sequence order.
+// At most 'depth' frames are loaded but not yet consumed at any time.
+class FramePrefetcher
+{
+public:
+    typedef std::function<void(int, SensorFrame &)> FrameLoader; // fills a frame given its position in the sequence
+
+    FramePrefetcher(FrameLoader loader, int numFrames, int depth, int numThreads);
+    ~FramePrefetcher();
+
+    bool next(SensorFrame &frame); // blocks until the next frame is ready, returns false at the end of the sequence
+    double stallTime() const { return stallTimeMs; } // total time in ms the consumer had to wait for I/O
+    int queueDepth(); // no. of frames loaded ahead of the consumer
+
+private:
+    void loadFrames();
+
+    FrameLoader loader;
+    int numFrames, depth;
+    int nextToLoad, nextToConsume;
+    bool bStop;
+    double stallTimeMs;
+
+    std::map<int, SensorFrame> readyFrames; // frames loaded ahead of the consumer, keyed by position
+    std::mutex mtx;
+    std::condition_variable loaderCondition, consumerCondition;
+    std::vector<std::thread> loaderThreads;
+};
+
+#endif /* framePrefetch_hpp */
@@ -0,0 +1,56 @@
+
+#include <iostream>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
+
+#include "framePreprocessing.hpp"
+
+using namespace std;
+
+// Compute all derived images of a camera frame once, so that detectors, extractors, the KLT tracker and
+// the object detector do not convert or resize the same image again; returns the processing time in ms.
+// Without a detector ROI the full frame is stretched to the detector input size, otherwise only the ROI
+// is scaled with preserved aspect ratio and centred on a grey letterbox border.
+float preprocessFrame(FrameProducts &products, cv::Mat &img, cv::Size detectorInputSize, bool bBuildPyramid, cv::Rect detectorRoi)
+{
+    double t = (double)cv::getTickCount();
+
+    cv::cvtColor(img, products.gray, cv::COLOR_BGR2GRAY);
+
+    DetectorInputTransform &transform = products.detectorTransform;
+    transform.roi = detectorRoi & cv::Rect(0, 0, img.cols, img.rows);
+    if (transform.roi.empty())
+    {
+        // same interpolation as cv::dnn::blobFromImage uses when resizing internally
+        cv::resize(img, products.detectorInput, detectorInputSize, 0, 0, cv::INTER_LINEAR);
+
+        transform.roi = cv::Rect(0, 0, img.cols, img.rows);
+        transform.scaleX = (float)detectorInputSize.width / img.cols;
+        transform.scaleY = (float)detectorInputSize.height / img.rows;
+        transform.pad = cv::Point2f(0, 0);
+    }
+    else
+    {
+        float scale = min((float)detectorInputSize.width / transform.roi.width, (float)detectorInputSize.height / transform.roi.height);
+        cv::Size scaledSize(cvRound(transform.roi.width * scale), cvRound(transform.roi.height * scale));
+        cv::Point offset((detectorInputSize.width - scaledSize.width) / 2, (detectorInputSize.height - scaledSize.height) / 2);
+
+        products.detectorInput.create(detectorInputSize, img.type());
+        products.detectorInput.setTo(cv::Scalar(127, 127, 127));
+        cv::Mat scaledRegion = products.detectorInput(cv::Rect(offset, scaledSize));
+        cv::resize(img(transform.roi), scaledRegion, scaledSize, 0, 0, cv::INTER_LINEAR);
+
+        transform.scaleX = transform.scaleY = scale;
+        transform.pad = cv::Point2f(offset.x, offset.y);
+    }
+
+    products.pyramid.clear();
+    if (bBuildPyramid)
+    {
+        products.pyramidWinSize = cv::Size(21, 21);
+        int maxLevel = 3;
+        products.pyramidMaxLevel = cv::buildOpticalFlowPyramid(products.gray, products.pyramid, products.pyramidWinSize, maxLevel);
+    }
+
+    return 1000.0 * ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+}
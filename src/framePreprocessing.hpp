@@ -0,0 +1,12 @@
+
+#ifndef framePreprocessing_hpp
+#define framePreprocessing_hpp
+
+#include <stdio.h>
+#include <opencv2/core.hpp>
+
+#include "dataStructures.h"
+
+float preprocessFrame(FrameProducts &products, cv::Mat &img, cv::Size detectorInputSize, bool bBuildPyramid, cv::Rect detectorRoi = cv::Rect());
+
+#endif /* framePreprocessing_hpp */
@@ -0,0 +1,211 @@
+
+#include <iostream>
+#include <cstring>
+#include <chrono>
+
+#include "frameStream.hpp"
+#include "lidarData.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+
+static const int maxStreamImageSize = 8192; // rows and cols of a pipe frame
+static const int maxStreamLidarPoints = 4000000; // Lidar points of a pipe frame (a KITTI scan has about 120000)
+
+
+static double ticksToMs(double ticks)
+{
+    return 1000.0 * ticks / cv::getTickFrequency();
+}
+
+
+FrameStream::FrameStream(std::string source, std::string lidarPattern, double frameRate, double deadlineMs)
+    : bOpen(false), bPipe(false), bEndOfStream(false), bStop(false), bHasLatest(false), lidarPattern(lidarPattern),
+      frameRate(frameRate), deadlineMs(deadlineMs), nextFrameNumber(0), latestCaptureTime(0.0)
+{
+    memset(&counters, 0, sizeof(counters));
+
+    string pipePrefix = "pipe:";
+    if (source.compare(0, pipePrefix.size(), pipePrefix) == 0)
+    {
+        bPipe = true;
+        pipe.open(source.substr(pipePrefix.size()), ios::in | ios::binary); // blocks until a writer has opened the pipe
+        bOpen = pipe.is_open();
+    }
+    else
+    {
+        bOpen = capture.open(source) && capture.isOpened();
+    }
+
+    if (!bOpen)
+    {
+        LOG_ERROR << "Couldn't open frame stream " << source;
+        return;
+    }
+    captureThread = thread(&FrameStream::captureFrames, this);
+}
+
+
+FrameStream::~FrameStream()
+{
+    {
+        lock_guard<mutex> lock(mtx);
+        bStop = true;
+    }
+    if (captureThread.joinable())
+        captureThread.join();
+}
+
+
+// Capture thread: read frames at the pace of the source and publish each one as the newest frame
+void FrameStream::captureFrames()
+{
+    double startTime = (double)cv::getTickCount();
+
+    while (true)
+    {
+        {
+            lock_guard<mutex> lock(mtx);
+            if (bStop)
+                break;
+        }
+
+        // a failure while reading ends the stream like its end would, instead of terminating the process from this thread
+        SensorFrame frame;
+        bool bHaveFrame = false;
+        try
+        {
+            bHaveFrame = bPipe ? readPipeFrame(frame) : readCaptureFrame(frame);
+        }
+        catch (const std::exception &e)
+        {
+            LOG_ERROR << "Reading the frame stream failed (" << e.what() << "), stopping stream";
+        }
+        if (!bHaveFrame)
+            break;
+
+        // recorded files are replayed at the sensor rate, a pipe feed is paced by its writer
+        if (!bPipe && frameRate > 0.0)
+        {
+            double dueMs = 1000.0 * frame.index / frameRate;
+            double waitMs = dueMs - ticksToMs((double)cv::getTickCount() - startTime);
+            if (waitMs > 0.0)
+                this_thread::sleep_for(chrono::microseconds((int64_t)(1000.0 * waitMs)));
+        }
+
+        lock_guard<mutex> lock(mtx);
+        counters.framesReceived++;
+        if (bHasLatest)
+            counters.framesDropped++; // the consumer is still busy, replace its pending frame by the newer one
+        latest = std::move(frame);
+        latestCaptureTime = (double)cv::getTickCount();
+        bHasLatest = true;
+        frameCondition.notify_all();
+    }
+
+    lock_guard<mutex> lock(mtx);
+    bEndOfStream = true;
+    frameCondition.notify_all();
+}
+
+
+bool FrameStream::readCaptureFrame(SensorFrame &frame)
+{
+    if (!capture.read(frame.cameraImg) || frame.cameraImg.empty())
+        return false;
+
+    frame.index = nextFrameNumber++;
+    frame.imgFile = to_string(frame.index);
+    frame.imgFullFilename = "stream frame " + frame.imgFile;
+
+    if (!lidarPattern.empty())
+    {
+        char lidarFile[1024];
+        snprintf(lidarFile, sizeof(lidarFile), lidarPattern.c_str(), frame.index);
+        loadLidarFromFile(frame.lidarPoints, lidarFile);
+    }
+    return true;
+}
+
+
+bool FrameStream::readPipeFrame(SensorFrame &frame)
+{
+    StreamFrameHeader header;
+    if (!pipe.read((char *)&header, sizeof(header)))
+        return false;
+
+    // the header comes from another process : only camera image types and sizes a sensor produces are accepted
+    bool bValid = strncmp(header.magic, "KSF1", 4) == 0 && (header.type == CV_8UC1 || header.type == CV_8UC3) &&
+                  header.rows > 0 && header.rows <= maxStreamImageSize && header.cols > 0 && header.cols <= maxStreamImageSize &&
+                  header.numLidarPoints >= 0 && header.numLidarPoints <= maxStreamLidarPoints;
+    if (!bValid)
+    {
+        LOG_ERROR << "Invalid record in frame feed, stopping stream";
+        return false;
+    }
+
+    frame.index = header.frameNumber;
+    frame.imgFile = to_string(frame.index);
+    frame.imgFullFilename = "stream frame " + frame.imgFile;
+
+    frame.cameraImg.create(header.rows, header.cols, header.type);
+    pipe.read((char *)frame.cameraImg.data, frame.cameraImg.total() * frame.cameraImg.elemSize());
+
+    vector<float> points(4 * header.numLidarPoints);
+    pipe.read((char *)points.data(), points.size() * sizeof(float));
+
+    frame.lidarPoints.resize(header.numLidarPoints);
+    for (int i = 0; i < header.numLidarPoints; ++i)
+    {
+        frame.lidarPoints.x[i] = points[4 * i];
+        frame.lidarPoints.y[i] = points[4 * i + 1];
+        frame.lidarPoints.z[i] = points[4 * i + 2];
+        frame.lidarPoints.r[i] = points[4 * i + 3];
+    }
+
+    return (bool)pipe;
+}
+
+
+bool FrameStream::next(SensorFrame &frame, double &captureTime)
+{
+    unique_lock<mutex> lock(mtx);
+    while (true)
+    {
+        frameCondition.wait(lock, [this] { return bHasLatest || bEndOfStream; });
+        if (!bHasLatest)
+            return false;
+
+        frame = std::move(latest);
+        captureTime = latestCaptureTime;
+        bHasLatest = false;
+
+        // a frame which has already used up its deadline waiting is skipped in favour of the next one
+        bool bStale = ticksToMs((double)cv::getTickCount() - captureTime) > deadlineMs;
+        if (!bStale || bEndOfStream)
+            return true;
+
+        counters.framesDropped++;
+    }
+}
+
+
+void FrameStream::frameDone(double captureTime)
+{
+    double latencyMs = ticksToMs((double)cv::getTickCount() - captureTime);
+
+    lock_guard<mutex> lock(mtx);
+    counters.framesProcessed++;
+    counters.totalLatencyMs += latencyMs;
+    counters.maxLatencyMs = max(counters.maxLatencyMs, latencyMs);
+    if (latencyMs > deadlineMs)
+        counters.deadlineMisses++;
+}
+
+
+StreamStats FrameStream::stats()
+{
+    lock_guard<mutex> lock(mtx);
+    return counters;
+}
@@ -0,0 +1,73 @@
+
+#ifndef frameStream_hpp
+#define frameStream_hpp
+
+#include <stdio.h>
+#include <cstdint>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <opencv2/core.hpp>
+#include <opencv2/videoio.hpp>
+
+#include "dataStructures.h"
+#include "framePrefetch.hpp"
+
+struct StreamFrameHeader { // record header of the frame feed protocol, followed by the image data and the Lidar points
+
+    char magic[4]; // "KSF1"
+    int32_t frameNumber; // sensor frame counter, used to compute the time between processed frames
+    int32_t rows, cols, type; // camera image layout (cv::Mat type), rows * cols * elemSize bytes follow
+    int32_t numLidarPoints; // no. of Lidar points which follow as x, y, z, r float32 quadruples (KITTI .bin layout)
+};
+
+struct StreamStats { // counters of a live stream
+
+    int framesReceived; // frames read from the source
+    int framesDropped; // frames discarded because processing fell behind (coalesced or too old)
+    int framesProcessed; // frames handed to and completed by the pipeline
+    int deadlineMisses; // processed frames whose end-to-end latency exceeded the deadline
+    double totalLatencyMs; // sum of capture-to-result latencies of processed frames
+    double maxLatencyMs; // largest capture-to-result latency
+};
+
+// Reads frames in real time on a background thread, either through cv::VideoCapture (video file or image
+// sequence pattern, paced at the sensor frame rate, Lidar scans from an optional printf-style file pattern) or
+// from a frame feed on a named pipe ("pipe:<path>", paced by the writer). Only the newest frame is kept for
+// the consumer, so frames arriving while the pipeline is busy are dropped instead of queued.
+class FrameStream
+{
+public:
+    FrameStream(std::string source, std::string lidarPattern, double frameRate, double deadlineMs);
+    ~FrameStream();
+
+    bool isOpen() const { return bOpen; }
+    bool next(SensorFrame &frame, double &captureTime); // blocks until a new frame is available, returns false at the end of the stream
+    void frameDone(double captureTime); // to be called when the results of a frame are available
+    StreamStats stats();
+
+private:
+    void captureFrames();
+    bool readCaptureFrame(SensorFrame &frame);
+    bool readPipeFrame(SensorFrame &frame);
+
+    bool bOpen, bPipe, bEndOfStream, bStop, bHasLatest;
+    std::string lidarPattern;
+    double frameRate, deadlineMs;
+    int nextFrameNumber;
+
+    cv::VideoCapture capture;
+    std::ifstream pipe;
+
+    SensorFrame latest; // newest frame not yet taken by the consumer
+    double latestCaptureTime; // tick count at which it was read
+    StreamStats counters;
+
+    std::mutex mtx;
+    std::condition_variable frameCondition;
+    std::thread captureThread;
+};
+
+#endif /* frameStream_hpp */
@@ -0,0 +1,122 @@
+
+#include <iostream>
+#include <cmath>
+#include <opencv2/core.hpp>
+
+#include "fusionSession.hpp"
+#include "objectDetection2D.hpp"
+#include "framePreprocessing.hpp"
+#include "lidarData.hpp"
+#include "lidarIndex.hpp"
+#include "matching2D.hpp"
+#include "frameArena.hpp"
+#include "camFusion.hpp"
+
+using namespace std;
+
+
+void kittiCalibration(cv::Mat &P_rect_00, cv::Mat &R_rect_00, cv::Mat &RT)
+{
+    P_rect_00.create(3,4,cv::DataType<double>::type); // 3x4 projection matrix after rectification
+    R_rect_00.create(4,4,cv::DataType<double>::type); // 3x3 rectifying rotation to make image planes co-planar
+    RT.create(4,4,cv::DataType<double>::type); // rotation matrix and translation vector
+
+    RT.at<double>(0,0) = 7.533745e-03; RT.at<double>(0,1) = -9.999714e-01; RT.at<double>(0,2) = -6.166020e-04; RT.at<double>(0,3) = -4.069766e-03;
+    RT.at<double>(1,0) = 1.480249e-02; RT.at<double>(1,1) = 7.280733e-04; RT.at<double>(1,2) = -9.998902e-01; RT.at<double>(1,3) = -7.631618e-02;
+    RT.at<double>(2,0) = 9.998621e-01; RT.at<double>(2,1) = 7.523790e-03; RT.at<double>(2,2) = 1.480755e-02; RT.at<double>(2,3) = -2.717806e-01;
+    RT.at<double>(3,0) = 0.0; RT.at<double>(3,1) = 0.0; RT.at<double>(3,2) = 0.0; RT.at<double>(3,3) = 1.0;
+    
+    R_rect_00.at<double>(0,0) = 9.999239e-01; R_rect_00.at<double>(0,1) = 9.837760e-03; R_rect_00.at<double>(0,2) = -7.445048e-03; R_rect_00.at<double>(0,3) = 0.0;
+    R_rect_00.at<double>(1,0) = -9.869795e-03; R_rect_00.at<double>(1,1) = 9.999421e-01; R_rect_00.at<double>(1,2) = -4.278459e-03; R_rect_00.at<double>(1,3) = 0.0;
+    R_rect_00.at<double>(2,0) = 7.402527e-03; R_rect_00.at<double>(2,1) = 4.351614e-03; R_rect_00.at<double>(2,2) = 9.999631e-01; R_rect_00.at<double>(2,3) = 0.0;
+    R_rect_00.at<double>(3,0) = 0; R_rect_00.at<double>(3,1) = 0; R_rect_00.at<double>(3,2) = 0; R_rect_00.at<double>(3,3) = 1;
+    
+    P_rect_00.at<double>(0,0) = 7.215377e+02; P_rect_00.at<double>(0,1) = 0.000000e+00; P_rect_00.at<double>(0,2) = 6.095593e+02; P_rect_00.at<double>(0,3) = 0.000000e+00;
+    P_rect_00.at<double>(1,0) = 0.000000e+00; P_rect_00.at<double>(1,1) = 7.215377e+02; P_rect_00.at<double>(1,2) = 1.728540e+02; P_rect_00.at<double>(1,3) = 0.000000e+00;
+    P_rect_00.at<double>(2,0) = 0.000000e+00; P_rect_00.at<double>(2,1) = 0.000000e+00; P_rect_00.at<double>(2,2) = 1.000000e+00; P_rect_00.at<double>(2,3) = 0.000000e+00;    
+}
+
+
+FusionSession::FusionSession(const FusionSessionConfig &config)
+    : config(config), matchKernel(selectMatchKernel(config.descriptorType, config.bCrossCheck)), ttcPool(config.ttcThreads)
+{
+    if (this->config.P_rect.empty() || this->config.R_rect.empty() || this->config.RT.empty())
+        kittiCalibration(this->config.P_rect, this->config.R_rect, this->config.RT);
+}
+
+
+int FusionSession::processFrame(SensorFrame &sensorFrame, int framesElapsed, std::vector<ObjectTTC> &results)
+{
+    results.clear();
+
+    // push image into data frame buffer
+    DataFrame frame;
+    frame.cameraImg = sensorFrame.cameraImg;
+    frame.imgFile = sensorFrame.imgFile;
+    dataBuffer.push_back(frame);
+    if (dataBuffer.size() > 2)
+        dataBuffer.erase(dataBuffer.begin());
+
+    DataFrame &currFrame = dataBuffer.back();
+    preprocessFrame(currFrame.imgProducts, currFrame.cameraImg, config.detectorInputSize, false);
+
+    // detect & classify objects, without visualization
+    detectObjects(currFrame.cameraImg, currFrame.boundingBoxes, config.tuning.confThreshold, config.nmsThreshold,
+                  config.yoloBasePath, config.yoloBasePath + "coco.names", config.yoloBasePath + "yolov3.cfg", config.yoloBasePath + "yolov3.weights",
+                  false, "", &currFrame.imgProducts.detectorInput, &currFrame.imgProducts.detectorTransform);
+
+    // crop Lidar points to the ego lane and associate them with the boxes
+    currFrame.lidarPoints = std::move(sensorFrame.lidarPoints);
+    cropLidarPoints(currFrame.lidarPoints, config.minX, config.maxX, config.maxY, config.minZ, config.maxZ, config.minR);
+    projectLidarToImage(currFrame.lidarDepth, currFrame.lidarPoints, currFrame.cameraImg.size(), config.P_rect, config.R_rect, config.RT);
+    clusterLidarWithROI(currFrame.boundingBoxes, currFrame.lidarPoints, currFrame.boxLidarPointIdx, currFrame.lidarDepth, config.tuning.shrinkFactor);
+
+    float clusterTolerance = 0.2; // max. distance in [m] between neighbouring points of the same object
+    int minClusterSize = 5;       // boxes with fewer points are left untouched
+    clusterLidarPointsInBoxes(currFrame.boundingBoxes, currFrame.lidarPoints, currFrame.boxLidarPointIdx, clusterTolerance, minClusterSize);
+
+    // keypoints and descriptors
+    cv::Mat &imgGray = currFrame.imgProducts.gray;
+    detKeypoints(currFrame.keypoints, imgGray, config.detectorType, false, "", config.tuning.fastThreshold, config.maxKeypoints);
+    selectKeypoints(currFrame.keypoints, config.maxKeypoints, config.keypointSelection, cv::Rect(0, 0, imgGray.cols, imgGray.rows));
+    descKeypoints(currFrame.keypoints, imgGray, currFrame.descriptors, config.descriptorType);
+
+    if (dataBuffer.size() > 1)
+    {
+        DataFrame &prevFrame = dataBuffer.front();
+
+        // match descriptors with the specialized kernel, brute force for descriptor layouts without one
+        if (matchDescriptorsKernel(matchKernel, prevFrame.descriptors, currFrame.descriptors, currFrame.kptMatches, config.tuning.maxDescDistRatio, matchScratch) < 0)
+            matchDescriptors(prevFrame.keypoints, currFrame.keypoints, prevFrame.descriptors, currFrame.descriptors, currFrame.kptMatches,
+                             config.descriptorType.compare("SIFT") == 0 ? "DES_HOG" : "DES_BINARY", "MAT_BF", "SEL_KNN", config.tuning.maxDescDistRatio);
+
+        // track boxes and compute the TTC of all matched pairs
+        matchBoundingBoxes(currFrame.kptMatches, currFrame.bbMatches, prevFrame, currFrame);
+        estimateBoxMotion(currFrame.bbMatches, prevFrame, currFrame);
+        evaluateObjects(prevFrame, currFrame, config.frameRate / max(framesElapsed, 1), ttcPool, evaluations, config.tuning.lidarNthPoint);
+
+        for (const auto &evaluation : evaluations)
+        {
+            if (!evaluation.bLidarSufficient)
+                continue;
+
+            const BoundingBox &box = currFrame.boundingBoxes[evaluation.currBoxIdx];
+            ObjectTTC result;
+            result.boxID = box.boxID;
+            result.classID = box.classID;
+            result.roi = box.roi;
+            result.ttcLidar = evaluation.ttcLidar;
+            result.ttcCamera = evaluation.ttcCamera;
+            result.numLidarPoints = box.lidarPoints.count;
+            result.numKptMatches = box.kptMatches.count;
+            results.push_back(result);
+        }
+    }
+
+    // release the transient buffers of this session's threads only, other sessions may be in the middle of a frame
+    vector<thread::id> threads = ttcPool.workerIds();
+    threads.push_back(this_thread::get_id());
+    resetFrameArenas(threads);
+
+    return (int)results.size();
+}
@@ -0,0 +1,71 @@
+
+#ifndef fusionSession_hpp
+#define fusionSession_hpp
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+#include <opencv2/core.hpp>
+
+#include "dataStructures.h"
+#include "framePrefetch.hpp"
+#include "matchingKernels.hpp"
+#include "taskPool.hpp"
+
+struct FusionSessionConfig { // sensors and pipeline settings of one camera/Lidar stream
+
+    std::string detectorType = "FAST"; // SHITOMASI, HARRIS, FAST, BRISK, ORB, AKAZE, SIFT
+    std::string descriptorType = "ORB"; // BRISK, ORB, AKAZE, SIFT
+    ExperimentConfig tuning; // thresholds
+
+    cv::Mat P_rect, R_rect, RT; // camera projection, rectifying rotation and Lidar-to-camera transform
+    float minX = 2.0, maxX = 20.0, maxY = 2.0, minZ = -1.5, maxZ = -0.9, minR = 0.1; // ego lane, Lidar points outside are removed
+
+    std::string yoloBasePath = "../dat/yolo/"; // coco.names, yolov3.cfg and yolov3.weights
+    cv::Size detectorInputSize = cv::Size(416, 416);
+    float nmsThreshold = 0.4;
+
+    int maxKeypoints = 0; // per-frame keypoint budget (0 = unlimited)
+    std::string keypointSelection = "KPT_GRID"; // KPT_GRID, KPT_ANMS, KPT_BEST
+    bool bCrossCheck = false; // keep only mutual best matches
+
+    double frameRate = 10.0; // sensor frame rate in Hz
+    int ttcThreads = 2; // no. of threads evaluating the TTC of matched objects
+};
+
+struct ObjectTTC { // TTC of an object tracked from the previous to the current frame
+
+    int boxID; // bounding box in the current frame
+    int classID;
+    cv::Rect roi;
+    double ttcLidar, ttcCamera; // time-to-collision in [s], NAN if it could not be estimated
+    int numLidarPoints; // Lidar points associated with the box
+    int numKptMatches; // keypoint matches within the box
+};
+
+void kittiCalibration(cv::Mat &P_rect_00, cv::Mat &R_rect_00, cv::Mat &RT); // calibration of the KITTI recordings
+
+// The fusion pipeline for one camera/Lidar stream. A session owns its ring buffer of frames, its matching state and its TTC
+// worker threads, and writes no images or windows. Sessions are independent and can run concurrently on different threads;
+// they share the detector network, which is loaded once per process. One session must only be used by one thread at a time.
+class FusionSession
+{
+public:
+    explicit FusionSession(const FusionSessionConfig &config);
+
+    // Process the next frame of the stream; framesElapsed is the no. of sensor frames since the previous call (> 1 after drops).
+    // Returns the no. of objects with a TTC, which are stored in results.
+    int processFrame(SensorFrame &frame, int framesElapsed, std::vector<ObjectTTC> &results);
+
+    const DataFrame *currentFrame() const { return dataBuffer.empty() ? nullptr : &dataBuffer.back(); }
+
+private:
+    FusionSessionConfig config;
+    std::vector<DataFrame> dataBuffer; // previous and current frame
+    MatchKernel matchKernel;
+    MatchScratch matchScratch;
+    TaskPool ttcPool;
+    std::vector<ObjectEvaluation> evaluations;
+};
+
+#endif /* fusionSession_hpp */
@@ -1,68 +1,79 @@
 
 #include <iostream>
 #include <algorithm>
+#include <limits>
+#include <cmath>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include "lidarData.hpp"
+#include "logger.hpp"
 
 
 using namespace std;
 
 // remove Lidar points based on min. and max distance in X, Y and Z
-void cropLidarPoints(std::vector<LidarPoint> &lidarPoints, float minX, float maxX, float maxY, float minZ, float maxZ, float minR)
+void cropLidarPoints(LidarPointCloud &lidarPoints, float minX, float maxX, float maxY, float minZ, float maxZ, float minR)
 {
-    std::vector<LidarPoint> newLidarPts; 
-    for(auto it=lidarPoints.begin(); it!=lidarPoints.end(); ++it) {
-        
-       if( (*it).x>=minX && (*it).x<=maxX && (*it).z>=minZ && (*it).z<=maxZ && (*it).z<=0.0 && abs((*it).y)<=maxY && (*it).r>=minR )  // Check if Lidar point is outside of boundaries
+    // compact the arrays in place; the condition is evaluated on contiguous float arrays
+    size_t numKept = 0;
+    for (size_t i = 0; i < lidarPoints.size(); ++i) {
+
+       float x = lidarPoints.x[i], y = lidarPoints.y[i], z = lidarPoints.z[i], r = lidarPoints.r[i];
+       if( x>=minX && x<=maxX && z>=minZ && z<=maxZ && z<=0.0f && fabs(y)<=maxY && r>=minR )  // Check if Lidar point is outside of boundaries
        {
-           newLidarPts.push_back(*it);
+           lidarPoints.x[numKept] = x;
+           lidarPoints.y[numKept] = y;
+           lidarPoints.z[numKept] = z;
+           lidarPoints.r[numKept] = r;
+           numKept++;
        }
     }
 
-    lidarPoints = newLidarPts;
+    lidarPoints.resize(numKept);
 }
 
 
 
-// Load Lidar points from a given location and store them in a vector
-void loadLidarFromFile(vector<LidarPoint> &lidarPoints, string filename)
+// Load Lidar points from a given location and store them in a point cloud
+void loadLidarFromFile(LidarPointCloud &lidarPoints, string filename)
 {
     // allocate 4 MB buffer (only ~130*4*4 KB are needed)
     unsigned long num = 1000000;
-    float *data = (float*)malloc(num*sizeof(float));
-    
-    // pointers
-    float *px = data+0;
-    float *py = data+1;
-    float *pz = data+2;
-    float *pr = data+3;
-    
+    vector<float> data(num);
+
     // load point cloud
     FILE *stream;
     stream = fopen (filename.c_str(),"rb");
-    num = fread(data,sizeof(float),num,stream)/4;
- 
-    for (int32_t i=0; i<num; i++) {
-        LidarPoint lpt;
-        lpt.x = *px; lpt.y = *py; lpt.z = *pz; lpt.r = *pr;
-        lidarPoints.push_back(lpt);
-        px+=4; py+=4; pz+=4; pr+=4;
+    if (stream == nullptr)
+    {
+        LOG_ERROR << "Couldn't open Lidar file " << filename;
+        return;
     }
+    num = fread(data.data(),sizeof(float),num,stream)/4;
     fclose(stream);
+
+    // de-interleave x,y,z,r records into separate arrays
+    size_t first = lidarPoints.size();
+    lidarPoints.resize(first + num);
+    for (size_t i=0; i<num; i++) {
+        lidarPoints.x[first + i] = data[4*i+0];
+        lidarPoints.y[first + i] = data[4*i+1];
+        lidarPoints.z[first + i] = data[4*i+2];
+        lidarPoints.r[first + i] = data[4*i+3];
+    }
 }
 
 
-void showLidarTopview(std::vector<LidarPoint> &lidarPoints, cv::Size worldSize, cv::Size imageSize, bool bWait)
+void showLidarTopview(LidarPointCloud &lidarPoints, cv::Size worldSize, cv::Size imageSize, bool bWait)
 {
     // create topview image
     cv::Mat topviewImg(imageSize, CV_8UC3, cv::Scalar(0, 0, 0));
 
     // plot Lidar points into image
-    for (auto it = lidarPoints.begin(); it != lidarPoints.end(); ++it)
+    for (size_t i = 0; i < lidarPoints.size(); ++i)
     {
-        float xw = (*it).x; // world position in m with x facing forward from sensor
-        float yw = (*it).y; // world position in m with y facing left from sensor
+        float xw = lidarPoints.x[i]; // world position in m with x facing forward from sensor
+        float yw = lidarPoints.y[i]; // world position in m with y facing left from sensor
 
         int y = (-xw * imageSize.height / worldSize.height) + imageSize.height;
         int x = (-yw * imageSize.height / worldSize.height) + imageSize.width / 2;
@@ -89,7 +100,7 @@ void showLidarTopview(std::vector<LidarPoint> &lidarPoints, cv::Size worldSize,
     }
 }
 
-void showLidarImgOverlay(cv::Mat &img, std::vector<LidarPoint> &lidarPoints, cv::Mat &P_rect_xx, cv::Mat &R_rect_xx, cv::Mat &RT, cv::Mat *extVisImg)
+void showLidarImgOverlay(cv::Mat &img, LidarPointCloud &lidarPoints, cv::Mat &P_rect_xx, cv::Mat &R_rect_xx, cv::Mat &RT, cv::Mat *extVisImg)
 {
     // init image for visualization
     cv::Mat visImg; 
@@ -105,18 +116,18 @@ void showLidarImgOverlay(cv::Mat &img, std::vector<LidarPoint> &lidarPoints, cv:
 
     // find max. x-value
     double maxVal = 0.0; 
-    for(auto it=lidarPoints.begin(); it!=lidarPoints.end(); ++it)
+    for(size_t i=0; i<lidarPoints.size(); ++i)
     {
-        maxVal = maxVal<it->x ? it->x : maxVal;
+        maxVal = maxVal<lidarPoints.x[i] ? lidarPoints.x[i] : maxVal;
     }
 
     cv::Mat X(4,1,cv::DataType<double>::type);
     cv::Mat Y(3,1,cv::DataType<double>::type);
-    for(auto it=lidarPoints.begin(); it!=lidarPoints.end(); ++it) {
+    for(size_t i=0; i<lidarPoints.size(); ++i) {
 
-            X.at<double>(0, 0) = it->x;
-            X.at<double>(1, 0) = it->y;
-            X.at<double>(2, 0) = it->z;
+            X.at<double>(0, 0) = lidarPoints.x[i];
+            X.at<double>(1, 0) = lidarPoints.y[i];
+            X.at<double>(2, 0) = lidarPoints.z[i];
             X.at<double>(3, 0) = 1;
 
             Y = P_rect_xx * R_rect_xx * RT * X;
@@ -125,7 +136,7 @@ void showLidarImgOverlay(cv::Mat &img, std::vector<LidarPoint> &lidarPoints, cv:
             pt.x = Y.at<double>(0, 0) / Y.at<double>(2, 0); 
             pt.y = Y.at<double>(1, 0) / Y.at<double>(2, 0); 
 
-            float val = it->x;
+            float val = lidarPoints.x[i];
             int red = min(255, (int)(255 * abs((val - maxVal) / maxVal)));
             int green = min(255, (int)(255 * (1 - abs((val - maxVal) / maxVal))));
             cv::circle(overlay, pt, 5, cv::Scalar(0, green, red), -1);
@@ -147,3 +158,216 @@ void showLidarImgOverlay(cv::Mat &img, std::vector<LidarPoint> &lidarPoints, cv:
         extVisImg = &visImg;
     }
 }
+
+
+// Image region covered by a box in Lidar coordinates (e.g. the ego-lane corridor used for cropping), enlarged by
+// a relative margin on each side and clipped to the image
+cv::Rect projectLidarCorridor(cv::Size imageSize, cv::Mat &P_rect_xx, cv::Mat &R_rect_xx, cv::Mat &RT,
+                              float minX, float maxX, float maxY, float minZ, float maxZ, float margin)
+{
+    cv::Mat P = P_rect_xx * R_rect_xx * RT;
+    cv::Mat X(4, 1, cv::DataType<double>::type);
+
+    float minU = numeric_limits<float>::max(), maxU = -minU, minV = minU, maxV = -minU;
+    for (int corner = 0; corner < 8; ++corner)
+    {
+        X.at<double>(0, 0) = corner & 1 ? maxX : minX;
+        X.at<double>(1, 0) = corner & 2 ? maxY : -maxY;
+        X.at<double>(2, 0) = corner & 4 ? maxZ : minZ;
+        X.at<double>(3, 0) = 1;
+
+        cv::Mat Y = P * X;
+        double w = Y.at<double>(2, 0);
+        if (w <= 0.0) // corner behind the camera, the corridor reaches the image border
+        {
+            minU = minV = -numeric_limits<float>::max();
+            maxU = maxV = numeric_limits<float>::max();
+            continue;
+        }
+        float u = Y.at<double>(0, 0) / w, v = Y.at<double>(1, 0) / w;
+        minU = min(minU, u); maxU = max(maxU, u);
+        minV = min(minV, v); maxV = max(maxV, v);
+    }
+
+    float marginU = margin * (maxU - minU), marginV = margin * (maxV - minV);
+    int left = (int)max(0.0f, minU - marginU), right = (int)min((float)imageSize.width, maxU + marginU);
+    int top = (int)max(0.0f, minV - marginV), bottom = (int)min((float)imageSize.height, maxV + marginV);
+
+    return cv::Rect(left, top, max(right - left, 0), max(bottom - top, 0));
+}
+
+
+// Project all Lidar points of a frame into the image once and store them in a row-indexed sparse depth image,
+// points behind the camera or outside the image are dropped
+void projectLidarToImage(LidarDepthImage &depthImg, LidarPointCloud &lidarPoints, cv::Size imageSize, cv::Mat &P_rect_xx, cv::Mat &R_rect_xx, cv::Mat &RT)
+{
+    // combine calibration into a single 3x4 projection matrix
+    cv::Mat P = P_rect_xx * R_rect_xx * RT;
+    double p[3][4];
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 4; ++j)
+            p[i][j] = P.at<double>(i, j);
+
+    // project all points in one pass over the contiguous coordinate arrays
+    size_t n = lidarPoints.size();
+    const float *px = lidarPoints.x.data(), *py = lidarPoints.y.data(), *pz = lidarPoints.z.data();
+    vector<float> u(n), v(n), w(n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        w[i] = p[2][0] * px[i] + p[2][1] * py[i] + p[2][2] * pz[i] + p[2][3];
+        u[i] = p[0][0] * px[i] + p[0][1] * py[i] + p[0][2] * pz[i] + p[0][3];
+        v[i] = p[1][0] * px[i] + p[1][1] * py[i] + p[1][2] * pz[i] + p[1][3];
+    }
+
+    // convert to pixel coordinates and count entries per image row
+    vector<cv::Point> pixels(n);
+    vector<int> rowCount(imageSize.height, 0);
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (w[i] <= 0.0f)
+        {
+            pixels[i] = cv::Point(-1, -1);
+            continue;
+        }
+
+        cv::Point pt;
+        pt.x = u[i] / w[i]; // pixel coordinates
+        pt.y = v[i] / w[i];
+        pixels[i] = pt;
+
+        if (pt.x >= 0 && pt.x < imageSize.width && pt.y >= 0 && pt.y < imageSize.height)
+            rowCount[pt.y]++;
+        else
+            pixels[i] = cv::Point(-1, -1);
+    }
+
+    // prefix sum over row counts yields the row index
+    depthImg.imageSize = imageSize;
+    depthImg.rowStart.assign(imageSize.height + 1, 0);
+    for (int v = 0; v < imageSize.height; ++v)
+        depthImg.rowStart[v + 1] = depthImg.rowStart[v] + rowCount[v];
+
+    int numEntries = depthImg.rowStart[imageSize.height];
+    depthImg.col.resize(numEntries);
+    depthImg.pointIdx.resize(numEntries);
+    depthImg.range.resize(numEntries);
+
+    vector<int> fill(depthImg.rowStart.begin(), depthImg.rowStart.end() - 1);
+    for (size_t i = 0; i < n; ++i)
+    {
+        if (pixels[i].x < 0)
+            continue;
+
+        int pos = fill[pixels[i].y]++;
+        depthImg.col[pos] = pixels[i].x;
+        depthImg.pointIdx[pos] = (int)i;
+        depthImg.range[pos] = px[i];
+    }
+
+    // sort each row by column so that column ranges can be found by binary search
+    vector<int> order;
+    for (int v = 0; v < imageSize.height; ++v)
+    {
+        int first = depthImg.rowStart[v], last = depthImg.rowStart[v + 1];
+        if (last - first < 2)
+            continue;
+
+        order.resize(last - first);
+        for (int k = 0; k < last - first; ++k)
+            order[k] = first + k;
+        std::stable_sort(order.begin(), order.end(), [&depthImg](int a, int b) { return depthImg.col[a] < depthImg.col[b]; });
+
+        vector<int> col(last - first), pointIdx(last - first);
+        vector<float> range(last - first);
+        for (int k = 0; k < last - first; ++k)
+        {
+            col[k] = depthImg.col[order[k]];
+            pointIdx[k] = depthImg.pointIdx[order[k]];
+            range[k] = depthImg.range[order[k]];
+        }
+        std::copy(col.begin(), col.end(), depthImg.col.begin() + first);
+        std::copy(pointIdx.begin(), pointIdx.end(), depthImg.pointIdx.begin() + first);
+        std::copy(range.begin(), range.end(), depthImg.range.begin() + first);
+    }
+}
+
+
+// Collect the positions of all depth image entries which fall into the given region of interest
+void lidarPointsInROI(const LidarDepthImage &depthImg, const cv::Rect &roi, ArenaVector<int> &entries)
+{
+    entries.clear();
+
+    int top = max(roi.y, 0), bottom = min(roi.y + roi.height, depthImg.imageSize.height);
+    for (int v = top; v < bottom; ++v)
+    {
+        auto rowBegin = depthImg.col.begin() + depthImg.rowStart[v];
+        auto rowEnd = depthImg.col.begin() + depthImg.rowStart[v + 1];
+
+        auto first = lower_bound(rowBegin, rowEnd, roi.x);
+        auto last = lower_bound(first, rowEnd, roi.x + roi.width);
+        for (auto it = first; it != last; ++it)
+            entries.push_back((int)(it - depthImg.col.begin()));
+    }
+}
+
+
+// Overlay the Lidar points associated with a bounding box, using the precomputed depth image; the box's points all
+// project into its region of interest, so only the depth image entries there have to be looked at
+void showLidarImgOverlay(cv::Mat &img, const LidarDepthImage &depthImg, const std::vector<int> &boxLidarPointIdx, const IndexSpan &boxLidarPoints,
+                         const cv::Rect &roi, cv::Mat *extVisImg)
+{
+    // init image for visualization
+    cv::Mat visImg;
+    if(extVisImg==nullptr)
+    {
+        visImg = img.clone();
+    } else
+    {
+        visImg = *extVisImg;
+    }
+
+    cv::Mat overlay = visImg.clone();
+
+    ArenaVector<int> boxPoints(boxLidarPointIdx.begin() + boxLidarPoints.first, boxLidarPointIdx.begin() + boxLidarPoints.first + boxLidarPoints.count);
+    std::sort(boxPoints.begin(), boxPoints.end());
+
+    // keep the entries of the region of interest which belong to the box, e.g. not those removed by the clustering
+    ArenaVector<int> roiEntries, entries;
+    lidarPointsInROI(depthImg, roi, roiEntries);
+    for (int e : roiEntries)
+    {
+        if (std::binary_search(boxPoints.begin(), boxPoints.end(), depthImg.pointIdx[e]))
+            entries.push_back(e);
+    }
+
+    // find max. x-value
+    double maxVal = 0.0;
+    for (int e : entries)
+    {
+        maxVal = maxVal<depthImg.range[e] ? depthImg.range[e] : maxVal;
+    }
+
+    int v = max(roi.y, 0);
+    for (int e : entries)
+    {
+        while (depthImg.rowStart[v + 1] <= e) // entries are ordered by row
+            ++v;
+
+        float val = depthImg.range[e];
+        int red = min(255, (int)(255 * abs((val - maxVal) / maxVal)));
+        int green = min(255, (int)(255 * (1 - abs((val - maxVal) / maxVal))));
+        cv::circle(overlay, cv::Point(depthImg.col[e], v), 5, cv::Scalar(0, green, red), -1);
+    }
+
+    float opacity = 0.6;
+    cv::addWeighted(overlay, opacity, visImg, 1 - opacity, 0, visImg);
+
+    // return augmented image or wait if no image has been provided
+    if (extVisImg == nullptr)
+    {
+        string windowName = "LiDAR data on image overlay";
+        cv::namedWindow( windowName, 3 );
+        cv::imshow( windowName, visImg );
+        cv::waitKey(0); // wait for key to be pressed
+    }
+}
@@ -7,10 +7,18 @@
 #include <string>
 
 #include "dataStructures.h"
+#include "frameArena.hpp"
 
-void cropLidarPoints(std::vector<LidarPoint> &lidarPoints, float minX, float maxX, float maxY, float minZ, float maxZ, float minR);
-void loadLidarFromFile(std::vector<LidarPoint> &lidarPoints, std::string filename);
+void cropLidarPoints(LidarPointCloud &lidarPoints, float minX, float maxX, float maxY, float minZ, float maxZ, float minR);
+void loadLidarFromFile(LidarPointCloud &lidarPoints, std::string filename);
 
-void showLidarTopview(std::vector<LidarPoint> &lidarPoints, cv::Size worldSize, cv::Size imageSize, bool bWait=true);
-void showLidarImgOverlay(cv::Mat &img, std::vector<LidarPoint> &lidarPoints, cv::Mat &P_rect_xx, cv::Mat &R_rect_xx, cv::Mat &RT, cv::Mat *extVisImg=nullptr);
+void showLidarTopview(LidarPointCloud &lidarPoints, cv::Size worldSize, cv::Size imageSize, bool bWait=true);
+void showLidarImgOverlay(cv::Mat &img, LidarPointCloud &lidarPoints, cv::Mat &P_rect_xx, cv::Mat &R_rect_xx, cv::Mat &RT, cv::Mat *extVisImg=nullptr);
+
+cv::Rect projectLidarCorridor(cv::Size imageSize, cv::Mat &P_rect_xx, cv::Mat &R_rect_xx, cv::Mat &RT,
+                              float minX, float maxX, float maxY, float minZ, float maxZ, float margin);
+void projectLidarToImage(LidarDepthImage &depthImg, LidarPointCloud &lidarPoints, cv::Size imageSize, cv::Mat &P_rect_xx, cv::Mat &R_rect_xx, cv::Mat &RT);
+void lidarPointsInROI(const LidarDepthImage &depthImg, const cv::Rect &roi, ArenaVector<int> &entries);
+void showLidarImgOverlay(cv::Mat &img, const LidarDepthImage &depthImg, const std::vector<int> &boxLidarPointIdx, const IndexSpan &boxLidarPoints,
+                         const cv::Rect &roi, cv::Mat *extVisImg=nullptr);
 #endif /* lidarData_hpp */
@@ -0,0 +1,173 @@
+
+#include <iostream>
+#include <algorithm>
+#include <cmath>
+#include <opencv2/core.hpp>
+
+#include "lidarIndex.hpp"
+
+using namespace std;
+
+
+// pack integer voxel coordinates into a single hash key (21 bits per axis)
+static int64_t voxelKey(int ix, int iy, int iz)
+{
+    const int64_t offset = 1 << 20;
+    return ((ix + offset) << 42) | ((iy + offset) << 21) | (iz + offset);
+}
+
+static int64_t voxelKeyOfPoint(float x, float y, float z, float voxelSize)
+{
+    return voxelKey((int)floor(x / voxelSize), (int)floor(y / voxelSize), (int)floor(z / voxelSize));
+}
+
+
+// Sort a subset of points (given as indices into the cloud) by their voxel so that each occupied voxel
+// refers to a contiguous range of subset positions
+void buildVoxelIndex(VoxelIndex &index, const LidarPointCloud &lidarPoints, const ArenaVector<int> &subset, float voxelSize)
+{
+    index.voxelSize = voxelSize;
+    index.cells.clear();
+
+    ArenaVector<pair<int64_t, int>> keyedPoints;
+    keyedPoints.reserve(subset.size());
+    for (int i = 0; i < (int)subset.size(); ++i)
+    {
+        int idx = subset[i];
+        keyedPoints.push_back(make_pair(voxelKeyOfPoint(lidarPoints.x[idx], lidarPoints.y[idx], lidarPoints.z[idx], voxelSize), i));
+    }
+    std::sort(keyedPoints.begin(), keyedPoints.end());
+
+    index.pointIndices.resize(keyedPoints.size());
+    index.cells.reserve(keyedPoints.size());
+    for (int i = 0; i < (int)keyedPoints.size(); ++i)
+    {
+        index.pointIndices[i] = keyedPoints[i].second;
+
+        bool isFirstPointInVoxel = i == 0 || keyedPoints[i].first != keyedPoints[i - 1].first;
+        if (isFirstPointInVoxel)
+            index.cells[keyedPoints[i].first] = make_pair(i, 1);
+        else
+            index.cells[keyedPoints[i].first].second++;
+    }
+}
+
+
+// Find all subset positions whose points lie within the given radius around the query position (radius must not exceed the voxel size)
+void radiusSearch(const VoxelIndex &index, const LidarPointCloud &lidarPoints, const ArenaVector<int> &subset, int query, float radius, ArenaVector<int> &neighbors)
+{
+    neighbors.clear();
+    float radiusSquared = radius * radius;
+
+    float qx = lidarPoints.x[subset[query]], qy = lidarPoints.y[subset[query]], qz = lidarPoints.z[subset[query]];
+    int ix = (int)floor(qx / index.voxelSize);
+    int iy = (int)floor(qy / index.voxelSize);
+    int iz = (int)floor(qz / index.voxelSize);
+
+    // only the 27 voxels around the query point can hold points within the radius
+    for (int dx = -1; dx <= 1; ++dx)
+    {
+        for (int dy = -1; dy <= 1; ++dy)
+        {
+            for (int dz = -1; dz <= 1; ++dz)
+            {
+                auto cell = index.cells.find(voxelKey(ix + dx, iy + dy, iz + dz));
+                if (cell == index.cells.end())
+                    continue;
+
+                int first = cell->second.first;
+                int last = first + cell->second.second;
+                for (int i = first; i < last; ++i)
+                {
+                    int idx = subset[index.pointIndices[i]];
+                    float ddx = lidarPoints.x[idx] - qx, ddy = lidarPoints.y[idx] - qy, ddz = lidarPoints.z[idx] - qz;
+                    if (ddx * ddx + ddy * ddy + ddz * ddz <= radiusSquared)
+                        neighbors.push_back(index.pointIndices[i]);
+                }
+            }
+        }
+    }
+}
+
+
+// Group the subset into clusters (of subset positions) by growing regions of points which are closer than clusterTolerance to each other
+void euclideanClustering(const VoxelIndex &index, const LidarPointCloud &lidarPoints, const ArenaVector<int> &subset, float clusterTolerance, int minClusterSize,
+                         ArenaVector<ArenaVector<int>> &clusters)
+{
+    ArenaVector<char> processed(subset.size(), false);
+    ArenaVector<int> neighbors;
+
+    for (int seed = 0; seed < (int)subset.size(); ++seed)
+    {
+        if (processed[seed])
+            continue;
+
+        ArenaVector<int> cluster;
+        cluster.push_back(seed);
+        processed[seed] = true;
+
+        // breadth-first region growing, the cluster itself serves as queue
+        for (size_t next = 0; next < cluster.size(); ++next)
+        {
+            radiusSearch(index, lidarPoints, subset, cluster[next], clusterTolerance, neighbors);
+            for (int n : neighbors)
+            {
+                if (!processed[n])
+                {
+                    processed[n] = true;
+                    cluster.push_back(n);
+                }
+            }
+        }
+
+        if ((int)cluster.size() >= minClusterSize)
+            clusters.push_back(std::move(cluster));
+    }
+}
+
+
+// Keep only the dominant (largest) Euclidean cluster of Lidar points in each bounding box to remove stray outliers,
+// the frame-level membership array is rebuilt without the removed points (in place, all scratch comes from the frame arena);
+// returns the processing time in ms
+double clusterLidarPointsInBoxes(std::vector<BoundingBox> &boundingBoxes, const LidarPointCloud &lidarPoints, std::vector<int> &boxLidarPointIdx,
+                                 float clusterTolerance, int minClusterSize)
+{
+    double t = (double)cv::getTickCount();
+
+    VoxelIndex index;
+    ArenaVector<int> boxPoints, clusteredPointIdx;
+    ArenaVector<ArenaVector<int>> clusters;
+    clusteredPointIdx.reserve(boxLidarPointIdx.size());
+    for (auto &box : boundingBoxes)
+    {
+        boxPoints.assign(boxLidarPointIdx.begin() + box.lidarPoints.first, boxLidarPointIdx.begin() + box.lidarPoints.first + box.lidarPoints.count);
+        box.lidarPoints.first = (int)clusteredPointIdx.size();
+
+        clusters.clear();
+        if (box.lidarPoints.count >= minClusterSize)
+        {
+            buildVoxelIndex(index, lidarPoints, boxPoints, clusterTolerance);
+            euclideanClustering(index, lidarPoints, boxPoints, clusterTolerance, minClusterSize, clusters);
+        }
+
+        if (clusters.empty())
+        {
+            clusteredPointIdx.insert(clusteredPointIdx.end(), boxPoints.begin(), boxPoints.end());
+            continue;
+        }
+
+        auto dominantCluster = max_element(clusters.begin(), clusters.end(),
+                                           [](const ArenaVector<int> &a, const ArenaVector<int> &b) { return a.size() < b.size(); });
+
+        // restore the original point order so downstream processing is unaffected by the clustering
+        std::sort(dominantCluster->begin(), dominantCluster->end());
+
+        for (int i : *dominantCluster)
+            clusteredPointIdx.push_back(boxPoints[i]);
+        box.lidarPoints.count = (int)dominantCluster->size();
+    }
+
+    boxLidarPointIdx.assign(clusteredPointIdx.begin(), clusteredPointIdx.end()); // never larger than before, so no reallocation
+
+    return 1000.0 * ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+}
@@ -0,0 +1,32 @@
+
+#ifndef lidarIndex_hpp
+#define lidarIndex_hpp
+
+#include <stdio.h>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+
+#include "dataStructures.h"
+#include "frameArena.hpp"
+
+// voxel hash over a subset of a Lidar point cloud, cell edge length equals the search radius; its memory comes from the
+// calling thread's frame arena, so an index must not outlive the frame
+struct VoxelIndex {
+
+    typedef std::unordered_map<int64_t, std::pair<int,int>, std::hash<int64_t>, std::equal_to<int64_t>,
+                               ArenaAllocator<std::pair<const int64_t, std::pair<int,int>>>> CellMap;
+
+    float voxelSize; // edge length of a voxel in [m]
+    ArenaVector<int> pointIndices; // positions in the indexed subset sorted by voxel, each voxel owns a contiguous range
+    CellMap cells; // voxel key -> (first position in pointIndices, no. of points)
+};
+
+void buildVoxelIndex(VoxelIndex &index, const LidarPointCloud &lidarPoints, const ArenaVector<int> &subset, float voxelSize);
+void radiusSearch(const VoxelIndex &index, const LidarPointCloud &lidarPoints, const ArenaVector<int> &subset, int query, float radius, ArenaVector<int> &neighbors);
+void euclideanClustering(const VoxelIndex &index, const LidarPointCloud &lidarPoints, const ArenaVector<int> &subset, float clusterTolerance, int minClusterSize,
+                         ArenaVector<ArenaVector<int>> &clusters);
+double clusterLidarPointsInBoxes(std::vector<BoundingBox> &boundingBoxes, const LidarPointCloud &lidarPoints, std::vector<int> &boxLidarPointIdx,
+                                 float clusterTolerance, int minClusterSize);
+
+#endif /* lidarIndex_hpp */
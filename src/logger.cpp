@@ -0,0 +1,243 @@
+
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "logger.hpp"
+
+using namespace std;
+
+std::atomic<int> runtimeLogLevel(LOG_LEVEL_INFO);
+static const size_t logBufferCapacity = 1 << 16; // per thread
+
+
+// Ring buffer of one thread's log lines: written by the owning thread only, read by the flusher (or flushLog)
+// under the flush mutex. Positions count bytes since creation, so head - tail is the no. of unread bytes.
+class LogBuffer
+{
+public:
+    explicit LogBuffer(size_t capacity) : bOwnerAlive(true), data(capacity), head(0), tail(0) {}
+
+    bool push(const char *line, size_t n)
+    {
+        size_t h = head.load(memory_order_relaxed);
+        if (n > data.size() - (h - tail.load(memory_order_acquire)))
+            return false;
+        size_t start = h % data.size(), first = min(n, data.size() - start);
+        memcpy(&data[start], line, first);
+        memcpy(&data[0], line + first, n - first);
+        head.store(h + n, memory_order_release);
+        return true;
+    }
+
+    void drain(string &out)
+    {
+        size_t t = tail.load(memory_order_relaxed), h = head.load(memory_order_acquire);
+        for (size_t pos = t; pos < h;)
+        {
+            size_t start = pos % data.size(), n = min(h - pos, data.size() - start);
+            out.append(&data[start], n);
+            pos += n;
+        }
+        tail.store(h, memory_order_release);
+    }
+
+    size_t capacity() const { return data.size(); }
+    size_t unread() const { return head.load(memory_order_acquire) - tail.load(memory_order_acquire); }
+
+    atomic<bool> bOwnerAlive;
+
+private:
+    vector<char> data;
+    atomic<size_t> head, tail;
+};
+
+
+class Logger
+{
+public:
+    Logger() : bWakeUp(false)
+    {
+        flusher = thread(&Logger::run, this);
+        flusher.detach(); // the logger lives until the process ends, remaining lines are written by flushLog at exit
+        atexit(flushLog);
+    }
+
+    shared_ptr<LogBuffer> registerThread()
+    {
+        auto buffer = make_shared<LogBuffer>(logBufferCapacity);
+        lock_guard<mutex> lock(buffersMutex);
+        buffers.push_back(buffer);
+        return buffer;
+    }
+
+    void wakeUp()
+    {
+        lock_guard<mutex> lock(wakeMutex);
+        bWakeUp = true;
+        wakeCondition.notify_one();
+    }
+
+    // Write the unread lines of all threads, followed by extraLine if given; returns once they have been written
+    void flush(const string *extraLine = nullptr)
+    {
+        lock_guard<mutex> lock(flushMutex);
+        batch.clear();
+        {
+            lock_guard<mutex> bufferLock(buffersMutex);
+            for (size_t i = 0; i < buffers.size();)
+            {
+                buffers[i]->drain(batch);
+                if (!buffers[i]->bOwnerAlive && buffers[i]->unread() == 0)
+                    buffers.erase(buffers.begin() + i); // the thread has ended
+                else
+                    ++i;
+            }
+        }
+        if (extraLine)
+            batch += *extraLine;
+
+        size_t written = 0;
+        while (written < batch.size())
+        {
+            ssize_t n = ::write(STDOUT_FILENO, batch.data() + written, batch.size() - written);
+            if (n <= 0)
+                break;
+            written += n;
+        }
+    }
+
+private:
+    void run()
+    {
+        while (true)
+        {
+            {
+                unique_lock<mutex> lock(wakeMutex);
+                wakeCondition.wait_for(lock, chrono::milliseconds(50), [this]() { return bWakeUp; });
+                bWakeUp = false;
+            }
+            flush();
+        }
+    }
+
+    vector<shared_ptr<LogBuffer>> buffers;
+    mutex buffersMutex, flushMutex, wakeMutex;
+    condition_variable wakeCondition;
+    bool bWakeUp;
+    string batch; // reused output of one flush
+    thread flusher;
+};
+
+
+static Logger &logger()
+{
+    static Logger *instance = new Logger; // never destroyed, threads may still log while static objects are destroyed
+    return *instance;
+}
+
+
+// Per-thread state : the buffer shared with the logger, and the stream lines are formatted in
+struct ThreadLog
+{
+    shared_ptr<LogBuffer> buffer;
+    ostringstream stream;
+    ios defaultFormat; // flags, precision and fill of a fresh stream
+    bool bStreamInUse;
+
+    ThreadLog() : buffer(logger().registerThread()), defaultFormat(nullptr), bStreamInUse(false) {}
+    ~ThreadLog() { buffer->bOwnerAlive = false; }
+};
+
+static ThreadLog &threadLog()
+{
+    static thread_local ThreadLog log;
+    return log;
+}
+
+
+void setLogLevel(LogLevel level)
+{
+    runtimeLogLevel = level;
+}
+
+
+bool parseLogLevel(const std::string &name, LogLevel &level)
+{
+    const char *names[] = {"error", "warn", "info", "debug"};
+    for (int i = 0; i <= LOG_LEVEL_DEBUG; ++i)
+    {
+        if (name == names[i])
+        {
+            level = (LogLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+void flushLog()
+{
+    logger().flush();
+}
+
+
+LogLine::LogLine(LogLevel level) : level(level)
+{
+    ThreadLog &log = threadLog();
+    if (log.bStreamInUse)
+    {
+        ownStream.reset(new ostringstream);
+        stream = ownStream.get();
+    }
+    else
+    {
+        log.bStreamInUse = true;
+        stream = &log.stream;
+        stream->str("");
+        stream->clear();
+        stream->copyfmt(log.defaultFormat); // manipulators of the previous line do not carry over
+    }
+
+    if (level == LOG_LEVEL_ERROR)
+        *stream << "ERROR: ";
+    else if (level == LOG_LEVEL_WARN)
+        *stream << "WARNING: ";
+}
+
+
+LogLine::~LogLine()
+{
+    ThreadLog &log = threadLog();
+    *stream << '\n';
+    string line = stream->str();
+    if (!ownStream)
+        log.bStreamInUse = false;
+
+    Logger &output = logger();
+    if (line.size() > log.buffer->capacity())
+    {
+        // too long for the buffer : written directly, after everything logged before it
+        output.flush(&line);
+        return;
+    }
+
+    // a full buffer is emptied by the flusher, the thread waits instead of dropping lines
+    while (!log.buffer->push(line.data(), line.size()))
+    {
+        output.wakeUp();
+        this_thread::yield();
+    }
+
+    // warnings and errors are written before the line returns, so they are not lost if the process dies right after
+    if (level <= LOG_LEVEL_WARN)
+        output.flush();
+    else if (log.buffer->unread() > log.buffer->capacity() / 2)
+        output.wakeUp();
+}
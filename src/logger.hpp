@@ -0,0 +1,62 @@
+
+#ifndef logger_hpp
+#define logger_hpp
+
+#include <stdio.h>
+#include <cstddef>
+#include <atomic>
+#include <string>
+#include <sstream>
+#include <memory>
+
+// Leveled logging to stdout. A log line is formatted on the calling thread and appended to that thread's buffer
+// without taking a lock; a background thread collects the buffers and writes them with a single system call.
+// Lines of one thread keep their order, lines of different threads are never interleaved within a line.
+
+enum LogLevel { LOG_LEVEL_ERROR = 0, LOG_LEVEL_WARN = 1, LOG_LEVEL_INFO = 2, LOG_LEVEL_DEBUG = 3 };
+
+// Lines above this level are removed at compile time, including the evaluation of their arguments
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_INFO
+#endif
+
+extern std::atomic<int> runtimeLogLevel;
+
+inline bool logEnabled(LogLevel level) { return level <= runtimeLogLevel.load(std::memory_order_relaxed); }
+void setLogLevel(LogLevel level); // lines above this level are skipped at runtime
+bool parseLogLevel(const std::string &name, LogLevel &level); // "error", "warn", "info", "debug"
+void flushLog(); // write all lines logged so far before returning (e.g. before waiting for user input)
+
+// One line of the log, handed to the thread's buffer when it goes out of scope; the newline is appended automatically, as
+// is the prefix "ERROR: " or "WARNING: " of the two highest levels
+class LogLine
+{
+public:
+    explicit LogLine(LogLevel level);
+    ~LogLine();
+
+    template <class T>
+    LogLine &operator<<(const T &value)
+    {
+        *stream << value;
+        return *this;
+    }
+    LogLine &operator<<(std::ostream &(*manipulator)(std::ostream &))
+    {
+        *stream << manipulator;
+        return *this;
+    }
+
+private:
+    LogLevel level;
+    std::ostringstream *stream; // the thread's reusable stream, or ownStream for a line logged while formatting another
+    std::unique_ptr<std::ostringstream> ownStream;
+};
+
+#define LOG_AT(level) if ((level) > LOG_COMPILE_LEVEL || !logEnabled(level)) {} else LogLine(level)
+#define LOG_ERROR LOG_AT(LOG_LEVEL_ERROR)
+#define LOG_WARN LOG_AT(LOG_LEVEL_WARN)
+#define LOG_INFO LOG_AT(LOG_LEVEL_INFO)
+#define LOG_DEBUG LOG_AT(LOG_LEVEL_DEBUG)
+
+#endif /* logger_hpp */
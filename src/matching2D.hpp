@@ -14,6 +14,7 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/features2d.hpp>
+#include <opencv2/video/tracking.hpp>
 #include <opencv2/xfeatures2d.hpp>
 #include <opencv2/xfeatures2d/nonfree.hpp>
 
@@ -21,10 +22,16 @@
 
 
 void detKeypointsHarris(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img);
-void detKeypointsShiTomasi(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img);
-float detKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, std::string detectorType, bool bVis, std::string fileName);
+void detKeypointsShiTomasi(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, int maxKeypoints=0);
+float detKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, std::string detectorType, bool bVis, std::string fileName, int fastThreshold=30, int maxKeypoints=0);
 float descKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, std::string descriptorType);
 void matchDescriptors(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::KeyPoint> &kPtsRef, cv::Mat &descSource, cv::Mat &descRef,
-                      std::vector<cv::DMatch> &matches, std::string descriptorType, std::string matcherType, std::string selectorType);
+                      std::vector<cv::DMatch> &matches, std::string descriptorType, std::string matcherType, std::string selectorType,
+                      float maxDescDistRatio=0.8);
+float trackKeypointsKLT(std::vector<cv::KeyPoint> &kPtsPrev, std::vector<cv::KeyPoint> &kPtsCurr, FrameProducts &imgPrev, FrameProducts &imgCurr,
+                        std::vector<BoundingBox> &boundingBoxesPrev, std::vector<cv::DMatch> &matches, float maxFwdBwdError);
+void selectKeypoints(std::vector<cv::KeyPoint> &keypoints, int maxKeypoints, std::string selectionType, cv::Rect roi);
+void selectKeypointsInBoxes(std::vector<cv::KeyPoint> &keypoints, std::vector<BoundingBox> &boundingBoxes, int maxKeypointsPerBox, std::string selectionType);
+void mergeDetectedKeypoints(std::vector<cv::KeyPoint> &keypoints, std::vector<cv::KeyPoint> &detectedKeypoints, float minDistance);
 
 #endif /* matching2D_hpp */
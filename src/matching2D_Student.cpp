@@ -1,11 +1,17 @@
 #include <numeric>
+#include <map>
+#include <cstdint>
+#include <algorithm>
 #include "matching2D.hpp"
+#include "logger.hpp"
 
 using namespace std;
 
-// Find best matches for keypoints in two camera images based on several matching methods
+// Find best matches for keypoints in two camera images based on several matching methods; SEL_KNN keeps a match if its
+// distance is below maxDescDistRatio times the distance of the second best one
 void matchDescriptors(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::KeyPoint> &kPtsRef, cv::Mat &descSource, cv::Mat &descRef,
-                     std::vector<cv::DMatch> &matches, std::string descriptorType, std::string matcherType, std::string selectorType)
+                     std::vector<cv::DMatch> &matches, std::string descriptorType, std::string matcherType, std::string selectorType,
+                     float maxDescDistRatio)
 {
     // configure matcher
     bool crossCheck = false;
@@ -13,7 +19,8 @@ void matchDescriptors(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::Key
 
     if (matcherType.compare("MAT_BF") == 0)
     {
-        int normType = cv::NORM_HAMMING;
+        // binary descriptors are compared by Hamming distance, float descriptors (SIFT) by L2
+        int normType = descSource.depth() == CV_32F ? cv::NORM_L2 : cv::NORM_HAMMING;
         matcher = cv::BFMatcher::create(normType, crossCheck);
     }
     else if (matcherType.compare("MAT_FLANN") == 0)
@@ -39,11 +46,12 @@ void matchDescriptors(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::Key
         int k = 2;
         vector<vector<cv::DMatch>> knnMatches;
         matcher->knnMatch(descSource, descRef, knnMatches, k);
-        double minDescDistRatio = 0.8;
 
-        for (vector<cv::DMatch> match : knnMatches)
+        for (const vector<cv::DMatch> &match : knnMatches)
         {
-            bool twoKeypointMatchesAreApart = match[0].distance < minDescDistRatio * match[1].distance;
+            if (match.empty())
+                continue;
+            bool twoKeypointMatchesAreApart = match.size() < 2 || match[0].distance < maxDescDistRatio * match[1].distance;
             if (twoKeypointMatchesAreApart) {
                 matches.push_back(match[0]);
             }
@@ -51,6 +59,228 @@ void matchDescriptors(std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::Key
     }
 }
 
+// Follow the previous frame's keypoints inside bounding boxes into the current image using pyramidal Lucas-Kanade;
+// tracks are kept if their forward-backward error is small and returned in the same form as descriptor matches
+float trackKeypointsKLT(std::vector<cv::KeyPoint> &kPtsPrev, std::vector<cv::KeyPoint> &kPtsCurr, FrameProducts &imgPrev, FrameProducts &imgCurr,
+                        std::vector<BoundingBox> &boundingBoxesPrev, std::vector<cv::DMatch> &matches, float maxFwdBwdError)
+{
+    double t = (double)cv::getTickCount();
+
+    // only keypoints on objects are of interest for TTC estimation
+    vector<int> prevIndices;
+    vector<cv::Point2f> ptsPrev;
+    for (int i = 0; i < (int)kPtsPrev.size(); ++i)
+    {
+        for (auto &box : boundingBoxesPrev)
+        {
+            if (box.roi.contains(kPtsPrev[i].pt))
+            {
+                prevIndices.push_back(i);
+                ptsPrev.push_back(kPtsPrev[i].pt);
+                break;
+            }
+        }
+    }
+
+    if (!ptsPrev.empty())
+    {
+        // reuse the pyramids built during frame preprocessing
+        cv::Size winSize = imgCurr.pyramidWinSize;
+        int maxLevel = min(imgPrev.pyramidMaxLevel, imgCurr.pyramidMaxLevel);
+        cv::TermCriteria criteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 30, 0.01);
+
+        // track forward into the current frame and back again
+        vector<cv::Point2f> ptsCurr, ptsBack;
+        vector<uchar> statusFwd, statusBwd;
+        vector<float> err;
+        cv::calcOpticalFlowPyrLK(imgPrev.pyramid, imgCurr.pyramid, ptsPrev, ptsCurr, statusFwd, err, winSize, maxLevel, criteria);
+        cv::calcOpticalFlowPyrLK(imgCurr.pyramid, imgPrev.pyramid, ptsCurr, ptsBack, statusBwd, err, winSize, maxLevel, criteria);
+
+        cv::Rect imgRect(0, 0, imgCurr.gray.cols, imgCurr.gray.rows);
+        for (size_t i = 0; i < ptsPrev.size(); ++i)
+        {
+            float fwdBwdError = cv::norm(ptsBack[i] - ptsPrev[i]);
+            if (!statusFwd[i] || !statusBwd[i] || fwdBwdError > maxFwdBwdError || !imgRect.contains(ptsCurr[i]))
+                continue;
+
+            cv::KeyPoint kpt = kPtsPrev[prevIndices[i]];
+            kpt.pt = ptsCurr[i];
+            kPtsCurr.push_back(kpt);
+
+            // query = previous frame, train = current frame, as in matchDescriptors
+            matches.push_back(cv::DMatch(prevIndices[i], (int)kPtsCurr.size() - 1, fwdBwdError));
+        }
+    }
+
+    float period = 1000.0 * ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+    LOG_DEBUG << "KLT tracking of " << ptsPrev.size() << " in-box keypoints kept " << matches.size() << " tracks in " << period << " ms";
+
+    return period;
+}
+
+
+// Append newly detected keypoints which are not too close to an already tracked keypoint
+void mergeDetectedKeypoints(std::vector<cv::KeyPoint> &keypoints, std::vector<cv::KeyPoint> &detectedKeypoints, float minDistance)
+{
+    if (minDistance <= 0.0 || keypoints.empty())
+    {
+        keypoints.insert(keypoints.end(), detectedKeypoints.begin(), detectedKeypoints.end());
+        return;
+    }
+
+    // hash existing keypoints into a grid with cell size minDistance, so only neighbouring cells need to be checked
+    auto cellKey = [minDistance](const cv::Point2f &pt, int du, int dv) {
+        int64_t u = (int)floor(pt.x / minDistance) + du, v = (int)floor(pt.y / minDistance) + dv;
+        return (v << 32) | (uint32_t)u;
+    };
+
+    std::map<int64_t, vector<int>> grid;
+    for (int i = 0; i < (int)keypoints.size(); ++i)
+        grid[cellKey(keypoints[i].pt, 0, 0)].push_back(i);
+
+    for (auto &kpt : detectedKeypoints)
+    {
+        bool bNearTrack = false;
+        for (int dv = -1; dv <= 1 && !bNearTrack; ++dv)
+        {
+            for (int du = -1; du <= 1 && !bNearTrack; ++du)
+            {
+                auto cell = grid.find(cellKey(kpt.pt, du, dv));
+                if (cell == grid.end())
+                    continue;
+
+                for (int i : cell->second)
+                {
+                    if (cv::norm(keypoints[i].pt - kpt.pt) < minDistance)
+                    {
+                        bNearTrack = true;
+                        break;
+                    }
+                }
+            }
+        }
+
+        if (!bNearTrack)
+            keypoints.push_back(kpt);
+    }
+}
+
+// Reduce keypoints to the maxKeypoints strongest ones, spread evenly over roi. Selection types:
+// KPT_GRID : the roi is divided into cells of about equal area which each keep their strongest keypoints, unused quota of sparse
+//            cells goes to the strongest remaining keypoints
+// KPT_ANMS : adaptive non-maximal suppression, keeps the keypoints which are farthest from any clearly stronger keypoint
+// KPT_BEST : the strongest keypoints regardless of their position (cv::KeyPointsFilter::retainBest)
+void selectKeypoints(std::vector<cv::KeyPoint> &keypoints, int maxKeypoints, std::string selectionType, cv::Rect roi)
+{
+    if (maxKeypoints <= 0 || (int)keypoints.size() <= maxKeypoints)
+        return;
+
+    auto byResponse = [](const cv::KeyPoint &a, const cv::KeyPoint &b) { return a.response > b.response; };
+
+    if (selectionType.compare("KPT_GRID") == 0 && !roi.empty())
+    {
+        // about four keypoints per cell, with square cells
+        int numCells = max(1, maxKeypoints / 4);
+        double cellSize = sqrt((double)roi.area() / numCells);
+        int gridCols = max(1, (int)ceil(roi.width / cellSize)), gridRows = max(1, (int)ceil(roi.height / cellSize));
+        int quota = max(1, maxKeypoints / (gridCols * gridRows));
+
+        vector<vector<cv::KeyPoint>> cells(gridCols * gridRows);
+        for (const auto &kpt : keypoints)
+        {
+            int col = min(max((int)((kpt.pt.x - roi.x) / cellSize), 0), gridCols - 1);
+            int row = min(max((int)((kpt.pt.y - roi.y) / cellSize), 0), gridRows - 1);
+            cells[row * gridCols + col].push_back(kpt);
+        }
+
+        vector<cv::KeyPoint> selected, remaining;
+        selected.reserve(maxKeypoints);
+        for (auto &cell : cells)
+        {
+            if ((int)cell.size() > quota)
+            {
+                std::nth_element(cell.begin(), cell.begin() + quota, cell.end(), byResponse);
+                remaining.insert(remaining.end(), cell.begin() + quota, cell.end());
+                cell.resize(quota);
+            }
+            selected.insert(selected.end(), cell.begin(), cell.end());
+        }
+
+        int numMissing = maxKeypoints - (int)selected.size();
+        if (numMissing > 0 && !remaining.empty())
+        {
+            numMissing = min(numMissing, (int)remaining.size());
+            std::nth_element(remaining.begin(), remaining.begin() + (numMissing - 1), remaining.end(), byResponse);
+            selected.insert(selected.end(), remaining.begin(), remaining.begin() + numMissing);
+        }
+        else if (numMissing < 0)
+        {
+            std::nth_element(selected.begin(), selected.begin() + maxKeypoints, selected.end(), byResponse);
+            selected.resize(maxKeypoints);
+        }
+
+        keypoints.swap(selected);
+    }
+    else if (selectionType.compare("KPT_ANMS") == 0)
+    {
+        // suppression radius of each keypoint: distance to the nearest keypoint which is clearly stronger (Brown et al., 2005).
+        // The O(n²) search is limited to the strongest keypoints, which is far more than the budget keeps.
+        const float robustness = 0.9;
+        int maxCandidates = 20 * maxKeypoints;
+        std::sort(keypoints.begin(), keypoints.end(), byResponse);
+        if ((int)keypoints.size() > maxCandidates)
+            keypoints.resize(maxCandidates);
+
+        vector<pair<float, int>> radii(keypoints.size()); // squared radius, position
+        for (int i = 0; i < (int)keypoints.size(); ++i)
+        {
+            float radius = numeric_limits<float>::max();
+            for (int j = 0; j < i && robustness * keypoints[j].response > keypoints[i].response; ++j)
+            {
+                cv::Point2f d = keypoints[i].pt - keypoints[j].pt;
+                radius = min(radius, d.x * d.x + d.y * d.y);
+            }
+            radii[i] = make_pair(radius, i);
+        }
+
+        std::nth_element(radii.begin(), radii.begin() + (maxKeypoints - 1), radii.end(),
+                         [](const pair<float, int> &a, const pair<float, int> &b) { return a.first > b.first; });
+
+        vector<cv::KeyPoint> selected(maxKeypoints);
+        for (int i = 0; i < maxKeypoints; ++i)
+            selected[i] = keypoints[radii[i].second];
+        keypoints.swap(selected);
+    }
+    else
+    {
+        cv::KeyPointsFilter::retainBest(keypoints, maxKeypoints);
+    }
+}
+
+
+// Apply the keypoint budget per bounding box instead of per frame: every box keeps up to maxKeypointsPerBox of the keypoints
+// inside it (a keypoint belongs to the first box containing it), keypoints outside all boxes are dropped
+void selectKeypointsInBoxes(std::vector<cv::KeyPoint> &keypoints, std::vector<BoundingBox> &boundingBoxes, int maxKeypointsPerBox, std::string selectionType)
+{
+    vector<vector<cv::KeyPoint>> keypointsInBox(boundingBoxes.size());
+    for (const auto &kpt : keypoints)
+    {
+        for (size_t b = 0; b < boundingBoxes.size(); ++b)
+            if (boundingBoxes[b].roi.contains(kpt.pt))
+            {
+                keypointsInBox[b].push_back(kpt);
+                break;
+            }
+    }
+
+    keypoints.clear();
+    for (size_t b = 0; b < boundingBoxes.size(); ++b)
+    {
+        selectKeypoints(keypointsInBox[b], maxKeypointsPerBox, selectionType, boundingBoxes[b].roi);
+        keypoints.insert(keypoints.end(), keypointsInBox[b].begin(), keypointsInBox[b].end());
+    }
+}
+
 // Use one of several types of state-of-art descriptors to uniquely identify keypoints
 float descKeypoints(vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &descriptors, string descriptorType)
 {
@@ -70,7 +300,7 @@ float descKeypoints(vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &desc
     else if (descriptorType.compare("FREAK") == 0) 
     {
         // extractor = cv::FREAK::create();
-        cout << "FREAK could not be run due to standard OpenCV install \n";
+        LOG_WARN << "FREAK could not be run due to standard OpenCV install";
     } 
     else if (descriptorType.compare("AKAZE") == 0) 
     {
@@ -82,16 +312,16 @@ float descKeypoints(vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &desc
     } 
     else 
     {
-      std::cout << descriptorType
-                << " is a not valid keypoint descriptor please select from ( "
-                   "BRISK, ORB, AKAZE, SIFT)\n";
+      LOG_WARN << descriptorType
+               << " is a not valid keypoint descriptor please select from ( "
+                   "BRISK, ORB, AKAZE, SIFT)";
     }
 
     // perform feature description
     double t = (double)cv::getTickCount();
     extractor->compute(img, keypoints, descriptors);
     t = ((double)cv::getTickCount() - t) / cv::getTickFrequency();
-    cout << descriptorType << " descriptor extraction in " << 1000 * t / 1.0 << " ms" << endl;
+    LOG_DEBUG << descriptorType << " descriptor extraction in " << 1000 * t / 1.0 << " ms";
 
     return t;
 }
@@ -102,14 +332,17 @@ float descKeypoints(vector<cv::KeyPoint> &keypoints, cv::Mat &img, cv::Mat &desc
 /* ------------------------------------------------------------------------------------------------------------------ */
 
 
-// Detect keypoints in image using the Shi-Thomasi detector
-void detKeypointsShiTomasi(vector<cv::KeyPoint> &keypoints, cv::Mat &img)
+// Detect keypoints in image using the Shi-Thomasi detector; with a keypoint budget only a small multiple of it is extracted,
+// which leaves the keypoint selection enough candidates to spread the budget over the image
+void detKeypointsShiTomasi(vector<cv::KeyPoint> &keypoints, cv::Mat &img, int maxKeypoints)
 {
     // compute detector parameters based on image size
     int blockSize = 4;       //  size of an average block for computing a derivative covariation matrix over each pixel neighborhood
     double maxOverlap = 0.0; // max. permissible overlap between two features in %
     double minDistance = (1.0 - maxOverlap) * blockSize;
     int maxCorners = img.rows * img.cols / max(1.0, minDistance); // max. num. of keypoints
+    if (maxKeypoints > 0)
+        maxCorners = min(maxCorners, 4 * maxKeypoints);
 
     double qualityLevel = 0.01; // minimal accepted quality of image corners
     double k = 0.04;
@@ -118,12 +351,13 @@ void detKeypointsShiTomasi(vector<cv::KeyPoint> &keypoints, cv::Mat &img)
     vector<cv::Point2f> corners;
     cv::goodFeaturesToTrack(img, corners, maxCorners, qualityLevel, minDistance, cv::Mat(), blockSize, false, k);
 
-    // add corners to result vector
-    for (auto c : corners)
+    // add corners to result vector; they are sorted by descending quality, which the rank keeps as response for keypoint selection
+    for (size_t i = 0; i < corners.size(); ++i)
     {
         cv::KeyPoint newKeyPoint;
-        newKeyPoint.pt = cv::Point2f(c.x, c.y);
+        newKeyPoint.pt = cv::Point2f(corners[i].x, corners[i].y);
         newKeyPoint.size = blockSize;
+        newKeyPoint.response = (float)(corners.size() - i);
         keypoints.push_back(newKeyPoint);
     }
 }
@@ -189,7 +423,7 @@ void detKeypointsHarris(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img)
 
 
 float detKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img,
-                        std::string detectorType, bool bVis, string fileName) 
+                        std::string detectorType, bool bVis, string fileName, int fastThreshold, int maxKeypoints) 
 {
   cv::Ptr<cv::FeatureDetector> detector;
   double t_start, period;
@@ -198,7 +432,7 @@ float detKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img,
 
   if (detectorType.compare("SHITOMASI") == 0) 
   {
-    detKeypointsShiTomasi(keypoints, img);
+    detKeypointsShiTomasi(keypoints, img, maxKeypoints);
   }
   else if (detectorType.compare("HARRIS") == 0) 
   {
@@ -206,8 +440,8 @@ float detKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img,
   }
   else if (detectorType.compare("FAST") == 0) 
   {
-    int threshold = 30; // difference between intensity of the central pixel and
-                        // pixels of a circle around this pixel
+    int threshold = fastThreshold; // difference between intensity of the central pixel and
+                                   // pixels of a circle around this pixel
     bool bNMS = true;   // perform non-maxima suppression on keypoints
     cv::FastFeatureDetector::DetectorType type =
                     cv::FastFeatureDetector::TYPE_9_16; // TYPE_9_16, TYPE_7_12, TYPE_5_8
@@ -235,14 +469,17 @@ float detKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img,
   } 
   else 
   {
-    std::cout << detectorType
-              << " is a not valid keypoint detectors please select from ( "
-                 "SHITOMASI, HARRIS, FAST, BRIEF, ORB, AKAZE, SIFT)\n";
+    LOG_WARN << detectorType
+             << " is a not valid keypoint detectors please select from ( "
+                 "SHITOMASI, HARRIS, FAST, BRIEF, ORB, AKAZE, SIFT)";
   }
 
   period = 1000.0f * ((double)cv::getTickCount() - t_start) / cv::getTickFrequency();
-  cout << detectorType << " detector with n= " << keypoints.size() << " keypoints in "
-       << period << " ms" << endl;
+  LOG_DEBUG << detectorType << " detector with n= " << keypoints.size() << " keypoints in "
+            << period << " ms";
+
+  if (!bVis && fileName.empty()) // neither shown nor saved
+    return period;
 
   cv::Mat visImage = img.clone();
   cv::drawKeypoints(img, keypoints, visImage, cv::Scalar::all(-1),
@@ -264,12 +501,12 @@ float detKeypoints(std::vector<cv::KeyPoint> &keypoints, cv::Mat &img,
     }
     catch (const cv::Exception& ex)
     {
-        std::cout << "Exception converting image in detKeypoints: " << ex.what() << std::endl;
+        LOG_ERROR << "Exception converting image in detKeypoints: " << ex.what();
     }
     if (result)
-        std::cout << "Saved JPG file in detKeypoints." << std::endl;
+        LOG_INFO << "Saved JPG file in detKeypoints.";
     else
-        std::cout << "ERROR: Couldn't save image in detKeypoints: " << fileName << std::endl;
+        LOG_ERROR << "Couldn't save image in detKeypoints: " << fileName;
     
   }
   return period;
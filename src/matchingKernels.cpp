@@ -0,0 +1,149 @@
+
+#include <iostream>
+
+#include "matchingKernels.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+
+template <class Distance>
+static MatchKernel makeMatchKernel(bool bCrossCheck)
+{
+    MatchKernel kernel;
+    kernel.match = bCrossCheck ? matchBruteForce<Distance, true> : matchBruteForce<Distance, false>;
+    kernel.matchGuided = bCrossCheck ? matchGuided<Distance, true> : matchGuided<Distance, false>;
+    kernel.descCols = Distance::cols;
+    kernel.descType = Distance::type;
+    return kernel;
+}
+
+
+static bool hasKernelLayout(const MatchKernel &kernel, const cv::Mat &desc)
+{
+    return desc.empty() || (desc.cols == kernel.descCols && desc.type() == kernel.descType);
+}
+
+
+// Pick the kernel specialized for the layout of the given descriptor type (to be done once before processing a sequence)
+MatchKernel selectMatchKernel(std::string descriptorType, bool bCrossCheck)
+{
+    if (descriptorType.compare("ORB") == 0 || descriptorType.compare("BRIEF") == 0)
+        return makeMatchKernel<HammingDistance<32>>(bCrossCheck);
+    if (descriptorType.compare("BRISK") == 0 || descriptorType.compare("FREAK") == 0)
+        return makeMatchKernel<HammingDistance<64>>(bCrossCheck);
+    if (descriptorType.compare("AKAZE") == 0)
+        return makeMatchKernel<HammingDistance<61>>(bCrossCheck);
+    if (descriptorType.compare("SIFT") == 0)
+        return makeMatchKernel<L2Distance<128>>(bCrossCheck);
+
+    MatchKernel kernel;
+    kernel.match = nullptr;
+    kernel.matchGuided = nullptr;
+    kernel.descCols = 0;
+    kernel.descType = -1;
+    return kernel;
+}
+
+
+// Kernel for descriptors compressed to numDims int8 components (see compressDescriptors)
+MatchKernel selectCompressedMatchKernel(int numDims, bool bCrossCheck)
+{
+    if (numDims == 32)
+        return makeMatchKernel<QuantizedL2Distance<32>>(bCrossCheck);
+    if (numDims == 64)
+        return makeMatchKernel<QuantizedL2Distance<64>>(bCrossCheck);
+
+    return selectMatchKernel("", bCrossCheck); // no kernel
+}
+
+
+// Match source against reference descriptors with a specialized kernel; returns the processing time in ms or -1
+// if the descriptors do not have the layout the kernel was specialized for
+float matchDescriptorsKernel(const MatchKernel &kernel, cv::Mat &descSource, cv::Mat &descRef, std::vector<cv::DMatch> &matches,
+                             float maxDistRatio, MatchScratch &scratch)
+{
+    if (kernel.match == nullptr || !hasKernelLayout(kernel, descSource) || !hasKernelLayout(kernel, descRef))
+        return -1.0;
+
+    double t = (double)cv::getTickCount();
+    kernel.match(descSource, descRef, maxDistRatio, matches, scratch);
+    float period = 1000.0 * ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+    LOG_DEBUG << "Brute-force matching of " << descSource.rows << " x " << descRef.rows << " descriptors in " << period << " ms";
+    return period;
+}
+
+
+// Bucket points into square cells covering their bounding rectangle (counting sort, so each cell owns a contiguous range)
+void buildMatchGrid(MatchGrid &grid, const std::vector<cv::Point2f> &points, float cellSize)
+{
+    grid.cellSize = cellSize;
+    grid.origin = cv::Point2f(0, 0);
+    grid.cols = grid.rows = 0;
+    grid.keypointIdx.resize(points.size());
+    if (points.empty())
+    {
+        grid.cellStart.assign(1, 0);
+        return;
+    }
+
+    float minX = points[0].x, maxX = minX, minY = points[0].y, maxY = minY;
+    for (const auto &pt : points)
+    {
+        minX = min(minX, pt.x); maxX = max(maxX, pt.x);
+        minY = min(minY, pt.y); maxY = max(maxY, pt.y);
+    }
+    grid.origin = cv::Point2f(minX, minY);
+    grid.cols = (int)((maxX - minX) / cellSize) + 1;
+    grid.rows = (int)((maxY - minY) / cellSize) + 1;
+
+    auto cellOf = [&grid](const cv::Point2f &pt) {
+        return (int)((pt.y - grid.origin.y) / grid.cellSize) * grid.cols + (int)((pt.x - grid.origin.x) / grid.cellSize);
+    };
+
+    grid.cellStart.assign(grid.cols * grid.rows + 1, 0);
+    for (const auto &pt : points)
+        grid.cellStart[cellOf(pt) + 1]++;
+    for (size_t c = 1; c < grid.cellStart.size(); ++c)
+        grid.cellStart[c] += grid.cellStart[c - 1];
+
+    vector<int> fill(grid.cellStart.begin(), grid.cellStart.end() - 1);
+    for (int i = 0; i < (int)points.size(); ++i)
+        grid.keypointIdx[fill[cellOf(points[i])]++] = i;
+}
+
+
+// Match with the spatially constrained kernel: source keypoints are moved by the image motion of the box they lie in
+// (constant-velocity prediction) and each reference keypoint is only compared against source keypoints within
+// searchRadius of its position; returns the processing time in ms or -1 if the kernel does not fit the descriptors
+float matchDescriptorsGuided(const MatchKernel &kernel, std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::KeyPoint> &kPtsRef, cv::Mat &descSource, cv::Mat &descRef,
+                             std::vector<BoundingBox> &boundingBoxesSource, float searchRadius, std::vector<cv::DMatch> &matches, float maxDistRatio,
+                             MatchScratch &scratch)
+{
+    if (kernel.matchGuided == nullptr || !hasKernelLayout(kernel, descSource) || !hasKernelLayout(kernel, descRef))
+        return -1.0;
+
+    double t = (double)cv::getTickCount();
+
+    scratch.predictedPts.resize(kPtsSource.size());
+    for (size_t i = 0; i < kPtsSource.size(); ++i)
+    {
+        scratch.predictedPts[i] = kPtsSource[i].pt;
+        for (const auto &box : boundingBoxesSource)
+        {
+            if (box.roi.contains(kPtsSource[i].pt))
+            {
+                scratch.predictedPts[i] += box.motion;
+                break;
+            }
+        }
+    }
+    buildMatchGrid(scratch.grid, scratch.predictedPts, searchRadius);
+
+    kernel.matchGuided(descSource, descRef, kPtsRef, searchRadius, maxDistRatio, matches, scratch);
+    float period = 1000.0 * ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+
+    LOG_DEBUG << "Guided matching of " << descRef.rows << " descriptors within " << searchRadius << " px in " << period << " ms";
+    return period;
+}
@@ -0,0 +1,301 @@
+
+#ifndef matchingKernels_hpp
+#define matchingKernels_hpp
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include <opencv2/core.hpp>
+
+#include "dataStructures.h"
+
+
+// Brute-force descriptor matching kernels which are specialized at compile time for the fixed descriptor layouts
+// produced by the extractors in descKeypoints. The distance loops have a constant trip count so the compiler can
+// fully unroll them. With the default build flags (Release, -mpopcnt, see CMakeLists.txt) binary distances use the
+// POPCNT instruction and float distances are vectorized into packed multiplies and adds (fused with NATIVE_ARCH on
+// CPUs with FMA); without -mpopcnt __builtin_popcountll becomes a library call.
+
+inline int popcount64(uint64_t x)
+{
+#if defined(__GNUC__)
+    return __builtin_popcountll(x);
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (int)((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+template <int NumBytes>
+struct HammingDistance // binary descriptor of NumBytes bytes (ORB/BRIEF 32, BRISK/FREAK 64, AKAZE 61)
+{
+    typedef uchar ElementType;
+    static const int cols = NumBytes;
+    static const int type = CV_8U;
+
+    static inline float distance(const uchar *a, const uchar *b)
+    {
+        int dist = 0;
+        for (int w = 0; w < NumBytes / 8; ++w)
+        {
+            uint64_t wa, wb;
+            std::memcpy(&wa, a + 8 * w, 8); // descriptor rows are not guaranteed to be 8-byte aligned
+            std::memcpy(&wb, b + 8 * w, 8);
+            dist += popcount64(wa ^ wb);
+        }
+        for (int i = NumBytes / 8 * 8; i < NumBytes; ++i) // remaining bytes of layouts which are no multiple of 8 (AKAZE)
+            dist += popcount64(a[i] ^ b[i]);
+
+        return (float)dist;
+    }
+};
+
+template <int NumFloats>
+struct L2Distance // float descriptor of NumFloats elements (SIFT 128)
+{
+    typedef float ElementType;
+    static const int cols = NumFloats;
+    static const int type = CV_32F;
+    static_assert(NumFloats % 8 == 0, "L2 kernel processes 8 lanes per step");
+
+    static inline float distance(const float *a, const float *b)
+    {
+        // independent accumulators per lane map onto one SIMD register and avoid a serial dependency chain
+        float acc[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+        for (int i = 0; i < NumFloats; i += 8)
+        {
+            for (int j = 0; j < 8; ++j)
+            {
+                float d = a[i + j] - b[i + j];
+                acc[j] += d * d;
+            }
+        }
+
+        return std::sqrt(((acc[0] + acc[1]) + (acc[2] + acc[3])) + ((acc[4] + acc[5]) + (acc[6] + acc[7])));
+    }
+};
+
+template <int NumDims>
+struct QuantizedL2Distance // int8 descriptor of NumDims elements (PCA-compressed SIFT 32/64, see descriptorCompression)
+{
+    typedef int8_t ElementType;
+    static const int cols = NumDims;
+    static const int type = CV_8S;
+    static_assert(NumDims % 16 == 0, "int8 kernel processes 16 lanes per step");
+
+    static inline float distance(const int8_t *a, const int8_t *b)
+    {
+        // 16-bit differences squared into 32-bit lanes, no overflow for |d| <= 254 and up to 64k dimensions
+        int32_t acc[16] = {0};
+        for (int i = 0; i < NumDims; i += 16)
+        {
+            for (int j = 0; j < 16; ++j)
+            {
+                int32_t d = (int32_t)a[i + j] - (int32_t)b[i + j];
+                acc[j] += d * d;
+            }
+        }
+
+        int32_t sum = 0;
+        for (int j = 0; j < 16; ++j)
+            sum += acc[j];
+        return std::sqrt((float)sum); // in quantization steps, the ratio test does not depend on the scale
+    }
+};
+
+
+struct MatchGrid { // keypoint positions bucketed into square cells, stored in compressed row storage
+
+    float cellSize; // edge length of a cell in pixels
+    cv::Point2f origin; // top-left corner of cell (0,0)
+    int cols, rows; // no. of cells
+    std::vector<int> cellStart; // first position in keypointIdx for each cell (cols * rows + 1 entries)
+    std::vector<int> keypointIdx; // keypoint indices ordered by cell
+};
+
+struct MatchScratch { // buffers reused across calls so matching does not allocate once they have grown to size
+
+    std::vector<float> bestDistReverse; // smallest distance seen for each descriptor of the other image (cross-check)
+    std::vector<int> bestIdxReverse; // descriptor which achieved it
+    std::vector<cv::Point2f> predictedPts; // source keypoint positions predicted for the reference image (guided matching)
+    MatchGrid grid; // spatial buckets of predictedPts (guided matching)
+};
+
+// Find the best reference match for each source descriptor with a fused ratio test (maxDistRatio <= 0 disables it)
+// and an optional cross-check; matches are written into the flat buffer in source order
+template <class Distance, bool CrossCheck>
+void matchBruteForce(const cv::Mat &descSource, const cv::Mat &descRef, float maxDistRatio, std::vector<cv::DMatch> &matches, MatchScratch &scratch)
+{
+    typedef typename Distance::ElementType T;
+
+    matches.resize(descSource.rows);
+    if (CrossCheck)
+    {
+        scratch.bestDistReverse.assign(descRef.rows, std::numeric_limits<float>::max());
+        scratch.bestIdxReverse.assign(descRef.rows, -1);
+    }
+
+    int numMatches = 0;
+    for (int q = 0; q < descSource.rows; ++q)
+    {
+        const T *descQuery = descSource.ptr<T>(q);
+        float bestDist = std::numeric_limits<float>::max(), secondDist = bestDist;
+        int bestIdx = -1;
+
+        for (int t = 0; t < descRef.rows; ++t)
+        {
+            float dist = Distance::distance(descQuery, descRef.ptr<T>(t));
+            if (dist < bestDist)
+            {
+                secondDist = bestDist;
+                bestDist = dist;
+                bestIdx = t;
+            }
+            else if (dist < secondDist)
+            {
+                secondDist = dist;
+            }
+
+            if (CrossCheck && dist < scratch.bestDistReverse[t])
+            {
+                scratch.bestDistReverse[t] = dist;
+                scratch.bestIdxReverse[t] = q;
+            }
+        }
+
+        bool bDistinctive = maxDistRatio <= 0.0 || bestDist < maxDistRatio * secondDist;
+        if (bestIdx >= 0 && bDistinctive)
+            matches[numMatches++] = cv::DMatch(q, bestIdx, bestDist);
+    }
+
+    if (CrossCheck) // keep only matches which are mutual best matches
+    {
+        int numMutual = 0;
+        for (int i = 0; i < numMatches; ++i)
+        {
+            if (scratch.bestIdxReverse[matches[i].trainIdx] == matches[i].queryIdx)
+                matches[numMutual++] = matches[i];
+        }
+        numMatches = numMutual;
+    }
+
+    matches.resize(numMatches);
+}
+
+
+// Like matchBruteForce, but each reference descriptor is only compared against the source keypoints whose position
+// (bucketed in scratch.grid) lies within searchRadius of the reference keypoint; the ratio test and cross-check
+// are evaluated among these candidates
+template <class Distance, bool CrossCheck>
+void matchGuided(const cv::Mat &descSource, const cv::Mat &descRef, const std::vector<cv::KeyPoint> &kptsRef, float searchRadius, float maxDistRatio,
+                 std::vector<cv::DMatch> &matches, MatchScratch &scratch)
+{
+    typedef typename Distance::ElementType T;
+    const MatchGrid &grid = scratch.grid;
+    const std::vector<cv::Point2f> &ptsSource = scratch.predictedPts;
+    float searchRadiusSquared = searchRadius * searchRadius;
+
+    matches.resize(descRef.rows);
+    if (CrossCheck)
+    {
+        scratch.bestDistReverse.assign(descSource.rows, std::numeric_limits<float>::max());
+        scratch.bestIdxReverse.assign(descSource.rows, -1);
+    }
+
+    int numMatches = 0;
+    for (int t = 0; t < descRef.rows; ++t)
+    {
+        const T *descTrain = descRef.ptr<T>(t);
+        const cv::Point2f &pt = kptsRef[t].pt;
+        float bestDist = std::numeric_limits<float>::max(), secondDist = bestDist;
+        int bestIdx = -1;
+
+        // range of cells overlapping the search window
+        int colFirst = std::max(0, (int)std::floor((pt.x - searchRadius - grid.origin.x) / grid.cellSize));
+        int colLast = std::min(grid.cols - 1, (int)std::floor((pt.x + searchRadius - grid.origin.x) / grid.cellSize));
+        int rowFirst = std::max(0, (int)std::floor((pt.y - searchRadius - grid.origin.y) / grid.cellSize));
+        int rowLast = std::min(grid.rows - 1, (int)std::floor((pt.y + searchRadius - grid.origin.y) / grid.cellSize));
+
+        for (int row = rowFirst; row <= rowLast; ++row)
+        {
+            for (int col = colFirst; col <= colLast; ++col)
+            {
+                int cell = row * grid.cols + col;
+                for (int k = grid.cellStart[cell]; k < grid.cellStart[cell + 1]; ++k)
+                {
+                    int q = grid.keypointIdx[k];
+                    float dx = ptsSource[q].x - pt.x, dy = ptsSource[q].y - pt.y;
+                    if (dx * dx + dy * dy > searchRadiusSquared)
+                        continue;
+
+                    float dist = Distance::distance(descSource.ptr<T>(q), descTrain);
+                    if (dist < bestDist)
+                    {
+                        secondDist = bestDist;
+                        bestDist = dist;
+                        bestIdx = q;
+                    }
+                    else if (dist < secondDist)
+                    {
+                        secondDist = dist;
+                    }
+
+                    if (CrossCheck && dist < scratch.bestDistReverse[q])
+                    {
+                        scratch.bestDistReverse[q] = dist;
+                        scratch.bestIdxReverse[q] = t;
+                    }
+                }
+            }
+        }
+
+        bool bDistinctive = maxDistRatio <= 0.0 || bestDist < maxDistRatio * secondDist;
+        if (bestIdx >= 0 && bDistinctive)
+            matches[numMatches++] = cv::DMatch(bestIdx, t, bestDist); // query = source, train = reference as in matchBruteForce
+    }
+
+    if (CrossCheck)
+    {
+        int numMutual = 0;
+        for (int i = 0; i < numMatches; ++i)
+        {
+            if (scratch.bestIdxReverse[matches[i].queryIdx] == matches[i].trainIdx)
+                matches[numMutual++] = matches[i];
+        }
+        numMatches = numMutual;
+    }
+
+    matches.resize(numMatches);
+}
+
+
+typedef void (*MatchKernelFn)(const cv::Mat &descSource, const cv::Mat &descRef, float maxDistRatio, std::vector<cv::DMatch> &matches, MatchScratch &scratch);
+typedef void (*MatchGuidedFn)(const cv::Mat &descSource, const cv::Mat &descRef, const std::vector<cv::KeyPoint> &kptsRef, float searchRadius, float maxDistRatio,
+                              std::vector<cv::DMatch> &matches, MatchScratch &scratch);
+
+struct MatchKernel { // matching kernel selected once per run for the descriptor type in use
+
+    MatchKernelFn match; // nullptr if there is no specialized kernel for the descriptor type
+    MatchGuidedFn matchGuided; // spatially constrained variant
+    int descCols; // expected descriptor layout
+    int descType;
+};
+
+MatchKernel selectMatchKernel(std::string descriptorType, bool bCrossCheck);
+MatchKernel selectCompressedMatchKernel(int numDims, bool bCrossCheck); // kernel for int8 descriptors of the given dimension
+float matchDescriptorsKernel(const MatchKernel &kernel, cv::Mat &descSource, cv::Mat &descRef, std::vector<cv::DMatch> &matches,
+                             float maxDistRatio, MatchScratch &scratch);
+void buildMatchGrid(MatchGrid &grid, const std::vector<cv::Point2f> &points, float cellSize);
+float matchDescriptorsGuided(const MatchKernel &kernel, std::vector<cv::KeyPoint> &kPtsSource, std::vector<cv::KeyPoint> &kPtsRef, cv::Mat &descSource, cv::Mat &descRef,
+                             std::vector<BoundingBox> &boundingBoxesSource, float searchRadius, std::vector<cv::DMatch> &matches, float maxDistRatio,
+                             MatchScratch &scratch);
+
+#endif /* matchingKernels_hpp */
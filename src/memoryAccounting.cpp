@@ -0,0 +1,300 @@
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <cstdlib>
+#include <malloc.h>
+#include <chrono>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include "memoryAccounting.hpp"
+
+using namespace std;
+
+std::atomic<bool> allocationAccountingEnabled(false);
+thread_local ThreadAllocationCounters *threadAllocationCounters = nullptr;
+
+// Counters of the counted threads. A slot is claimed when a thread starts counting; when it ends, its counts move to the
+// retired counters and the slot becomes free again.
+static const int maxCountedThreads = 256;
+static ThreadAllocationCounters threadSlots[maxCountedThreads];
+static bool slotInUse[maxCountedThreads];
+static AllocationCounters retiredCounters;
+static mutex slotsMutex; // claiming and retiring slots, summing them
+
+static AllocationCounters readCounters(const ThreadAllocationCounters &counters)
+{
+    return AllocationCounters{counters.numAllocations.load(memory_order_relaxed), counters.bytesAllocated.load(memory_order_relaxed),
+                              counters.numFrees.load(memory_order_relaxed), counters.bytesFreed.load(memory_order_relaxed)};
+}
+
+
+class CountedThread
+{
+public:
+    CountedThread() : slot(-1)
+    {
+        lock_guard<mutex> lock(slotsMutex);
+        for (int i = 0; i < maxCountedThreads && slot < 0; ++i)
+        {
+            if (!slotInUse[i])
+            {
+                slotInUse[i] = true;
+                slot = i;
+            }
+        }
+        if (slot >= 0)
+            threadAllocationCounters = &threadSlots[slot];
+    }
+
+    ~CountedThread()
+    {
+        if (slot < 0)
+            return;
+        threadAllocationCounters = nullptr;
+
+        lock_guard<mutex> lock(slotsMutex);
+        ThreadAllocationCounters &counters = threadSlots[slot];
+        retiredCounters += readCounters(counters);
+        for (auto *counter : {&counters.numAllocations, &counters.bytesAllocated, &counters.numFrees, &counters.bytesFreed})
+            counter->store(0, memory_order_relaxed);
+        slotInUse[slot] = false;
+    }
+
+private:
+    int slot; // -1 if all slots are taken, the thread is not counted then
+};
+
+
+// cv::Mat buffers are not allocated through operator new. The default allocator is wrapped instead: allocations are
+// delegated to it and the buffer is marked as ours, so that its release comes back here.
+class CountingMatAllocator : public cv::MatAllocator
+{
+public:
+    explicit CountingMatAllocator(cv::MatAllocator *base) : base(base) {}
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step, cv::AccessFlag flags,
+                           cv::UMatUsageFlags usageFlags) const override
+    {
+        cv::UMatData *u = base->allocate(dims, sizes, type, data, step, flags, usageFlags);
+        if (u && !(u->flags & cv::UMatData::USER_ALLOCATED))
+        {
+            countHeapAllocation(u->size);
+            u->currAllocator = this;
+        }
+        return u;
+    }
+
+    bool allocate(cv::UMatData *data, cv::AccessFlag accessflags, cv::UMatUsageFlags usageFlags) const override
+    {
+        return base->allocate(data, accessflags, usageFlags);
+    }
+
+    void deallocate(cv::UMatData *u) const override
+    {
+        if (!u)
+            return;
+        countHeapFree(u->size);
+        u->currAllocator = base;
+        base->deallocate(u);
+    }
+
+private:
+    cv::MatAllocator *base;
+};
+
+
+void enableAllocationAccounting()
+{
+    static once_flag installed;
+    call_once(installed, []() {
+        static CountingMatAllocator matAllocator(cv::Mat::getDefaultAllocator());
+        cv::Mat::setDefaultAllocator(&matAllocator);
+    });
+    allocationAccountingEnabled = true;
+}
+
+
+void countThreadAllocations()
+{
+    static thread_local CountedThread countedThread;
+    (void)countedThread;
+}
+
+
+AllocationCounters allocationCounters()
+{
+    lock_guard<mutex> lock(slotsMutex);
+    AllocationCounters counters = retiredCounters;
+    for (int i = 0; i < maxCountedThreads; ++i)
+    {
+        if (slotInUse[i])
+            counters += readCounters(threadSlots[i]);
+    }
+    return counters;
+}
+
+
+// Time blocks allocated and freed with and without counting them; the difference is what accounting adds to every
+// allocation of a counted thread (the hooks also query the usable size of each block)
+double measureAccountingOverhead(int numAllocations)
+{
+    ThreadAllocationCounters scratch;
+    for (auto *counter : {&scratch.numAllocations, &scratch.bytesAllocated, &scratch.numFrees, &scratch.bytesFreed})
+        counter->store(0, memory_order_relaxed);
+
+    auto timeAllocations = [numAllocations](ThreadAllocationCounters *counters) {
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < numAllocations; ++i)
+        {
+            void *p = malloc(64 + (i & 63));
+            if (counters)
+                countAllocation(counters, malloc_usable_size(p));
+            if (counters)
+                countFree(counters, malloc_usable_size(p));
+            free(p);
+        }
+        return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+    };
+
+    timeAllocations(nullptr); // warm up the allocator
+    double plainNs = timeAllocations(nullptr);
+    double countedNs = timeAllocations(&scratch);
+    return max(countedNs - plainNs, 0.0) / max(numAllocations, 1);
+}
+
+
+AllocationCounters operator-(const AllocationCounters &a, const AllocationCounters &b)
+{
+    return AllocationCounters{a.numAllocations - b.numAllocations, a.bytesAllocated - b.bytesAllocated, a.numFrees - b.numFrees, a.bytesFreed - b.bytesFreed};
+}
+
+
+AllocationCounters &operator+=(AllocationCounters &a, const AllocationCounters &b)
+{
+    a.numAllocations += b.numAllocations;
+    a.bytesAllocated += b.bytesAllocated;
+    a.numFrees += b.numFrees;
+    a.bytesFreed += b.bytesFreed;
+    return a;
+}
+
+
+size_t residentBytes()
+{
+    // second field of statm : resident pages
+    ifstream statm("/proc/self/statm");
+    size_t totalPages = 0, residentPages = 0;
+    statm >> totalPages >> residentPages;
+    return residentPages * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+
+// The high water mark in /proc/self/status can be reset, unlike the peak getrusage reports, so that consecutive runs in one
+// process each get their own peak
+size_t peakResidentBytes()
+{
+    ifstream status("/proc/self/status");
+    string line;
+    while (getline(status, line))
+    {
+        if (line.compare(0, 6, "VmHWM:") == 0)
+            return (size_t)stoull(line.substr(6)) * 1024; // kB
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return (size_t)usage.ru_maxrss * 1024; // kB on Linux
+}
+
+
+bool resetPeakResidentBytes()
+{
+    ofstream clearRefs("/proc/self/clear_refs");
+    clearRefs << "5"; // reset the peak resident set size to the current one
+    clearRefs.flush();
+    return clearRefs.good();
+}
+
+
+static size_t matBytes(const cv::Mat &m)
+{
+    return m.empty() ? 0 : m.total() * m.elemSize();
+}
+
+template <class T>
+static size_t vectorBytes(const std::vector<T> &v)
+{
+    return v.capacity() * sizeof(T);
+}
+
+
+size_t FrameFootprint::total() const
+{
+    return cameraImg + imgProducts + keypoints + descriptors + kptMatches + lidarPoints + lidarDepth + boundingBoxes + boxIndex + bbMatches;
+}
+
+
+// Memory held by the frame's members; images shared with other frames or views into them are counted in full
+FrameFootprint frameFootprint(const DataFrame &frame)
+{
+    FrameFootprint footprint;
+    footprint.cameraImg = matBytes(frame.cameraImg);
+
+    footprint.imgProducts = matBytes(frame.imgProducts.gray) + matBytes(frame.imgProducts.detectorInput);
+    for (const auto &level : frame.imgProducts.pyramid)
+        footprint.imgProducts += matBytes(level);
+
+    footprint.keypoints = vectorBytes(frame.keypoints);
+    footprint.descriptors = matBytes(frame.descriptors) + matBytes(frame.compressedDescriptors);
+    footprint.kptMatches = vectorBytes(frame.kptMatches);
+
+    const LidarPointCloud &points = frame.lidarPoints;
+    footprint.lidarPoints = vectorBytes(points.x) + vectorBytes(points.y) + vectorBytes(points.z) + vectorBytes(points.r);
+
+    const LidarDepthImage &depth = frame.lidarDepth;
+    footprint.lidarDepth = vectorBytes(depth.rowStart) + vectorBytes(depth.col) + vectorBytes(depth.pointIdx) + vectorBytes(depth.range);
+
+    footprint.boundingBoxes = vectorBytes(frame.boundingBoxes);
+    footprint.boxIndex = vectorBytes(frame.boxLidarPointIdx) + vectorBytes(frame.boxKptMatchIdx);
+
+    // std::map node : key/value plus colour and three pointers
+    footprint.bbMatches = frame.bbMatches.size() * (sizeof(std::pair<const int, int>) + 4 * sizeof(void *));
+
+    return footprint;
+}
+
+
+StageAllocations::StageAllocations(int numStages)
+    : last(allocationCounters()), frameCounters(numStages, AllocationCounters{0, 0, 0, 0}),
+      runCounters(numStages, AllocationCounters{0, 0, 0, 0}), frames(0)
+{
+}
+
+
+void StageAllocations::restart()
+{
+    last = allocationCounters();
+}
+
+
+void StageAllocations::lap(int stage)
+{
+    AllocationCounters now = allocationCounters();
+    frameCounters[stage] += now - last;
+    last = now;
+}
+
+
+void StageAllocations::endFrame()
+{
+    for (size_t stage = 0; stage < frameCounters.size(); ++stage)
+    {
+        runCounters[stage] += frameCounters[stage];
+        frameCounters[stage] = AllocationCounters{0, 0, 0, 0};
+    }
+    frames++;
+}
@@ -0,0 +1,108 @@
+
+#ifndef memoryAccounting_hpp
+#define memoryAccounting_hpp
+
+#include <stdio.h>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+#include <vector>
+
+#include "dataStructures.h"
+
+struct AllocationCounters { // heap allocations (operator new and cv::Mat buffers) of the counted threads
+
+    uint64_t numAllocations;
+    uint64_t bytesAllocated; // usable size of the allocated blocks
+    uint64_t numFrees;
+    uint64_t bytesFreed;
+};
+
+AllocationCounters operator-(const AllocationCounters &a, const AllocationCounters &b);
+AllocationCounters &operator+=(AllocationCounters &a, const AllocationCounters &b);
+
+struct ThreadAllocationCounters { // written by its thread only, read by allocationCounters()
+
+    std::atomic<uint64_t> numAllocations, bytesAllocated, numFrees, bytesFreed;
+};
+
+// Only allocations and frees made by counted threads are counted, on the thread making them: the pipeline's own thread and
+// its TaskPool workers. Loader, capture, logger and metrics threads run concurrently and are left out.
+extern std::atomic<bool> allocationAccountingEnabled;
+extern thread_local ThreadAllocationCounters *threadAllocationCounters; // null if the thread is not counted
+
+inline void countAllocation(ThreadAllocationCounters *counters, size_t bytes)
+{
+    counters->numAllocations.fetch_add(1, std::memory_order_relaxed);
+    counters->bytesAllocated.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+inline void countFree(ThreadAllocationCounters *counters, size_t bytes)
+{
+    counters->numFrees.fetch_add(1, std::memory_order_relaxed);
+    counters->bytesFreed.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+// Called by the allocation hooks : the global operator new and delete are replaced by the executable (allocationHooks.cpp),
+// never by the library, so that programs linking it keep their allocator
+inline void countHeapAllocation(size_t bytes)
+{
+    ThreadAllocationCounters *counters = threadAllocationCounters;
+    if (counters && allocationAccountingEnabled.load(std::memory_order_relaxed))
+        countAllocation(counters, bytes);
+}
+
+inline void countHeapFree(size_t bytes)
+{
+    ThreadAllocationCounters *counters = threadAllocationCounters;
+    if (counters && allocationAccountingEnabled.load(std::memory_order_relaxed))
+        countFree(counters, bytes);
+}
+
+void enableAllocationAccounting(); // start counting, cv::Mat buffers are only counted if they are allocated afterwards
+void countThreadAllocations(); // count the calling thread's allocations until it ends
+AllocationCounters allocationCounters(); // totals of the counted threads since they have been counted
+double measureAccountingOverhead(int numAllocations = 1000000); // added cost of counting one allocation and its free in ns
+size_t residentBytes(); // current resident set size of the process
+size_t peakResidentBytes(); // highest resident set size since the last reset (or since the process started)
+bool resetPeakResidentBytes(); // start a new peak at the current resident set size, false if the kernel does not allow it
+
+struct FrameFootprint { // heap memory held by the members of a DataFrame in bytes
+
+    size_t cameraImg;
+    size_t imgProducts; // grayscale image, pyramid and detector input
+    size_t keypoints;
+    size_t descriptors; // full and compressed
+    size_t kptMatches;
+    size_t lidarPoints;
+    size_t lidarDepth;
+    size_t boundingBoxes; // the boxes themselves, their members are spans into the index arrays
+    size_t boxIndex; // boxLidarPointIdx and boxKptMatchIdx
+    size_t bbMatches;
+
+    size_t total() const;
+};
+
+FrameFootprint frameFootprint(const DataFrame &frame);
+
+// Attributes the allocations between consecutive laps to pipeline stages, per frame and summed over a run
+class StageAllocations
+{
+public:
+    explicit StageAllocations(int numStages);
+
+    void restart(); // the first stage of a frame starts now
+    void lap(int stage); // allocations since the previous lap belong to the given stage
+    void endFrame(); // add the frame's counters to the run and clear them
+
+    const std::vector<AllocationCounters> &frame() const { return frameCounters; }
+    const std::vector<AllocationCounters> &run() const { return runCounters; }
+    int numFrames() const { return frames; }
+
+private:
+    AllocationCounters last;
+    std::vector<AllocationCounters> frameCounters, runCounters;
+    int frames;
+};
+
+#endif /* memoryAccounting_hpp */
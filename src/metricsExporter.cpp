@@ -0,0 +1,331 @@
+
+#include <iostream>
+#include <sstream>
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "metricsExporter.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+
+MetricHistogram::MetricHistogram(const std::vector<double> &bounds)
+    : bounds(bounds), counts(new std::atomic<uint64_t>[bounds.size() + 1]), sum(0.0)
+{
+    for (size_t i = 0; i <= bounds.size(); ++i)
+        counts[i].store(0);
+}
+
+
+void MetricHistogram::observe(double v)
+{
+    size_t bucket = 0;
+    while (bucket < bounds.size() && v > bounds[bucket])
+        bucket++;
+    counts[bucket].fetch_add(1, std::memory_order_relaxed);
+
+    // there is no atomic add for double in C++11, the loop practically never repeats with a single writer
+    double expected = sum.load(std::memory_order_relaxed);
+    while (!sum.compare_exchange_weak(expected, expected + v, std::memory_order_relaxed))
+        ;
+}
+
+
+void *MetricsRegistry::find(const std::string &name, const std::string &labels)
+{
+    auto family = familyIndex.find(name);
+    if (family == familyIndex.end())
+        return nullptr;
+    for (const auto &series : families[family->second].series)
+        if (series.labels == labels)
+            return series.metric;
+    return nullptr;
+}
+
+
+void MetricsRegistry::add(const std::string &name, const std::string &help, const std::string &type, const std::string &labels, void *metric)
+{
+    auto family = familyIndex.find(name);
+    if (family == familyIndex.end())
+    {
+        familyIndex[name] = (int)families.size();
+        families.push_back(Family{name, help, type, {}});
+        family = familyIndex.find(name);
+    }
+    families[family->second].series.push_back(Series{labels, metric});
+}
+
+
+MetricCounter *MetricsRegistry::counter(std::string name, std::string help, std::string labels)
+{
+    lock_guard<mutex> lock(mtx);
+    if (void *metric = find(name, labels))
+        return static_cast<MetricCounter *>(metric);
+
+    counters.emplace_back();
+    add(name, help, "counter", labels, &counters.back());
+    return &counters.back();
+}
+
+
+MetricGauge *MetricsRegistry::gauge(std::string name, std::string help, std::string labels)
+{
+    lock_guard<mutex> lock(mtx);
+    if (void *metric = find(name, labels))
+        return static_cast<MetricGauge *>(metric);
+
+    gauges.emplace_back();
+    add(name, help, "gauge", labels, &gauges.back());
+    return &gauges.back();
+}
+
+
+MetricHistogram *MetricsRegistry::histogram(std::string name, std::string help, const std::vector<double> &bounds, std::string labels)
+{
+    lock_guard<mutex> lock(mtx);
+    if (void *metric = find(name, labels))
+        return static_cast<MetricHistogram *>(metric);
+
+    histograms.emplace_back(bounds);
+    add(name, help, "histogram", labels, &histograms.back());
+    return &histograms.back();
+}
+
+
+static string labelSet(const string &labels, const string &extra = "")
+{
+    if (labels.empty() && extra.empty())
+        return "";
+    return "{" + labels + (labels.empty() || extra.empty() ? "" : ",") + extra + "}";
+}
+
+
+// Prometheus text exposition format (version 0.0.4), all series of a metric family are grouped under its HELP and TYPE lines
+std::string MetricsRegistry::render()
+{
+    ostringstream ss;
+    ss.precision(10);
+
+    lock_guard<mutex> lock(mtx);
+    for (const auto &family : families)
+    {
+        ss << "# HELP " << family.name << " " << family.help << "\n";
+        ss << "# TYPE " << family.name << " " << family.type << "\n";
+
+        for (const auto &series : family.series)
+        {
+            if (family.type == "counter")
+            {
+                ss << family.name << labelSet(series.labels) << " " << static_cast<MetricCounter *>(series.metric)->value.load() << "\n";
+            }
+            else if (family.type == "gauge")
+            {
+                ss << family.name << labelSet(series.labels) << " " << static_cast<MetricGauge *>(series.metric)->value.load() << "\n";
+            }
+            else
+            {
+                MetricHistogram *histogram = static_cast<MetricHistogram *>(series.metric);
+                uint64_t cumulative = 0;
+                for (size_t i = 0; i < histogram->bounds.size(); ++i)
+                {
+                    cumulative += histogram->counts[i].load();
+                    ostringstream le;
+                    le << "le=\"" << histogram->bounds[i] << "\"";
+                    ss << family.name << "_bucket" << labelSet(series.labels, le.str()) << " " << cumulative << "\n";
+                }
+                cumulative += histogram->counts[histogram->bounds.size()].load();
+                ss << family.name << "_bucket" << labelSet(series.labels, "le=\"+Inf\"") << " " << cumulative << "\n";
+                ss << family.name << "_sum" << labelSet(series.labels) << " " << histogram->sum.load() << "\n";
+                ss << family.name << "_count" << labelSet(series.labels) << " " << cumulative << "\n";
+            }
+        }
+    }
+    return ss.str();
+}
+
+
+MetricsRegistry &metrics()
+{
+    static MetricsRegistry registry;
+    return registry;
+}
+
+
+std::vector<double> latencyBucketsMs()
+{
+    return {1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000};
+}
+
+
+// Time what recording one stage costs on the hot path, for comparison with the stage durations
+double measureMetricsOverhead(int numObservations)
+{
+    MetricHistogram histogram(latencyBucketsMs());
+    MetricCounter counter;
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < numObservations; ++i)
+    {
+        histogram.observe((double)(i % 1000));
+        counter.inc();
+    }
+    double elapsedNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+
+    return elapsedNs / max(numObservations, 1);
+}
+
+
+double StageTimer::lap(MetricHistogram *histogram)
+{
+    auto now = chrono::steady_clock::now();
+    double ms = chrono::duration<double, milli>(now - last).count();
+    last = now;
+    histogram->observe(ms);
+    return ms;
+}
+
+
+MetricsExporter::MetricsExporter(MetricsRegistry &registry, std::string endpoint, std::string dumpFile, double dumpInterval)
+    : registry(registry), endpoint(endpoint), dumpFile(dumpFile), dumpInterval(dumpInterval), listenFd(-1), bOpen(false), bStop(false)
+{
+    string unixPrefix = "unix:";
+    if (endpoint.compare(0, unixPrefix.size(), unixPrefix) == 0)
+    {
+        socketPath = endpoint.substr(unixPrefix.size());
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+
+        unlink(socketPath.c_str()); // left over from an earlier run
+        listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd >= 0 && (::bind(listenFd, (sockaddr *)&address, sizeof(address)) != 0 || listen(listenFd, 4) != 0))
+        {
+            close(listenFd);
+            listenFd = -1;
+        }
+    }
+    else if (!endpoint.empty())
+    {
+        sockaddr_in address;
+        memset(&address, 0, sizeof(address));
+        address.sin_family = AF_INET;
+        address.sin_port = htons((uint16_t)atoi(endpoint.c_str()));
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK); // local scraping only
+
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        int reuse = 1;
+        if (listenFd >= 0)
+            setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (listenFd >= 0 && (::bind(listenFd, (sockaddr *)&address, sizeof(address)) != 0 || listen(listenFd, 4) != 0))
+        {
+            close(listenFd);
+            listenFd = -1;
+        }
+    }
+
+    if (!endpoint.empty() && listenFd < 0)
+        LOG_ERROR << "Couldn't serve metrics on " << endpoint;
+
+    bOpen = listenFd >= 0 || !dumpFile.empty();
+    if (bOpen)
+        serverThread = thread(&MetricsExporter::serve, this);
+}
+
+
+MetricsExporter::~MetricsExporter()
+{
+    bStop = true;
+    if (serverThread.joinable())
+        serverThread.join();
+
+    if (listenFd >= 0)
+        close(listenFd);
+    if (!socketPath.empty())
+        unlink(socketPath.c_str());
+
+    if (!dumpFile.empty())
+        dump(); // final state of the run
+}
+
+
+// Answer scrapes and dump the metrics periodically until the exporter is destroyed
+void MetricsExporter::serve()
+{
+    auto lastDump = chrono::steady_clock::now();
+    while (!bStop)
+    {
+        if (listenFd >= 0)
+        {
+            pollfd fd = {listenFd, POLLIN, 0};
+            if (poll(&fd, 1, 200) > 0 && (fd.revents & POLLIN))
+            {
+                int connection = accept(listenFd, nullptr, nullptr);
+                if (connection >= 0)
+                {
+                    respond(connection);
+                    close(connection);
+                }
+            }
+        }
+        else
+        {
+            this_thread::sleep_for(chrono::milliseconds(200));
+        }
+
+        if (!dumpFile.empty() && chrono::duration<double>(chrono::steady_clock::now() - lastDump).count() >= dumpInterval)
+        {
+            dump();
+            lastDump = chrono::steady_clock::now();
+        }
+    }
+}
+
+
+// Every request is answered with the metrics, the request line itself is not interpreted
+void MetricsExporter::respond(int connection)
+{
+    char request[4096];
+    pollfd fd = {connection, POLLIN, 0};
+    if (poll(&fd, 1, 1000) > 0)
+        recv(connection, request, sizeof(request), 0);
+
+    string body = registry.render();
+    ostringstream response;
+    response << "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " << body.size() << "\r\nConnection: close\r\n\r\n" << body;
+
+    string data = response.str();
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+        ssize_t n = send(connection, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+            break;
+        sent += n;
+    }
+}
+
+
+// Write to a temporary file first, so a reader never sees a partial dump
+void MetricsExporter::dump()
+{
+    string tmpFile = dumpFile + ".tmp";
+    {
+        ofstream file(tmpFile);
+        file << registry.render();
+        if (!file)
+        {
+            LOG_ERROR << "Couldn't write metrics to " << tmpFile;
+            return;
+        }
+    }
+    rename(tmpFile.c_str(), dumpFile.c_str());
+}
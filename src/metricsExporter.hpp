@@ -0,0 +1,113 @@
+
+#ifndef metricsExporter_hpp
+#define metricsExporter_hpp
+
+#include <stdio.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <mutex>
+
+// Metrics are updated with relaxed atomics only, so recording them on the hot path costs a few ns and never blocks.
+
+struct MetricCounter { // monotonically increasing count
+
+    std::atomic<uint64_t> value;
+
+    MetricCounter() : value(0) {}
+    void inc(uint64_t n = 1) { value.fetch_add(n, std::memory_order_relaxed); }
+};
+
+struct MetricGauge { // current value of a quantity which can go up and down
+
+    std::atomic<double> value;
+
+    MetricGauge() : value(0.0) {}
+    void set(double v) { value.store(v, std::memory_order_relaxed); }
+};
+
+struct MetricHistogram { // distribution of observed values over fixed buckets
+
+    std::vector<double> bounds; // upper bounds of the buckets in ascending order, values above the last go to the +Inf bucket
+    std::unique_ptr<std::atomic<uint64_t>[]> counts; // per bucket (not cumulative), bounds.size() + 1 entries, _count is their sum
+    std::atomic<double> sum;
+
+    explicit MetricHistogram(const std::vector<double> &bounds);
+    void observe(double v);
+};
+
+// Named metrics of the process, rendered in the Prometheus text exposition format. A metric is identified by its
+// name and label set ('stage="match"'); registering it again returns the existing one, so registration can be
+// repeated for every experiment while the returned pointers stay valid for the lifetime of the registry.
+class MetricsRegistry
+{
+public:
+    MetricCounter *counter(std::string name, std::string help, std::string labels = "");
+    MetricGauge *gauge(std::string name, std::string help, std::string labels = "");
+    MetricHistogram *histogram(std::string name, std::string help, const std::vector<double> &bounds, std::string labels = "");
+
+    std::string render();
+
+private:
+    struct Series { std::string labels; void *metric; };
+    struct Family { std::string name, help, type; std::vector<Series> series; };
+
+    void *find(const std::string &name, const std::string &labels);
+    void add(const std::string &name, const std::string &help, const std::string &type, const std::string &labels, void *metric);
+
+    std::deque<MetricCounter> counters;
+    std::deque<MetricGauge> gauges;
+    std::deque<MetricHistogram> histograms;
+    std::vector<Family> families; // in order of registration
+    std::map<std::string, int> familyIndex;
+    std::mutex mtx;
+};
+
+MetricsRegistry &metrics(); // registry of the process
+std::vector<double> latencyBucketsMs(); // 1 ms ... 5 s
+double measureMetricsOverhead(int numObservations = 1000000); // ns per histogram observation plus counter increment
+
+// Records the duration of consecutive pipeline stages: each lap() observes the time since the previous lap
+class StageTimer
+{
+public:
+    StageTimer() : last(std::chrono::steady_clock::now()) {}
+
+    void restart() { last = std::chrono::steady_clock::now(); }
+    double lap(MetricHistogram *histogram);
+
+private:
+    std::chrono::steady_clock::time_point last;
+};
+
+// Serves the registry over HTTP on a local TCP port ("9464", bound to 127.0.0.1) or a Unix socket ("unix:<path>"),
+// and/or writes it to a file every dumpInterval seconds, on a background thread
+class MetricsExporter
+{
+public:
+    MetricsExporter(MetricsRegistry &registry, std::string endpoint, std::string dumpFile, double dumpInterval);
+    ~MetricsExporter();
+
+    bool isOpen() const { return bOpen; }
+
+private:
+    void serve();
+    void respond(int connection);
+    void dump();
+
+    MetricsRegistry &registry;
+    std::string endpoint, dumpFile, socketPath;
+    double dumpInterval;
+    int listenFd;
+    bool bOpen;
+    std::atomic<bool> bStop;
+    std::thread serverThread;
+};
+
+#endif /* metricsExporter_hpp */
@@ -2,12 +2,15 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <mutex>
 
 #include <opencv2/dnn.hpp>
 #include <opencv2/imgproc.hpp>
 #include <opencv2/highgui.hpp>
 
 #include "objectDetection2D.hpp"
+#include "detectorModel.hpp"
+#include "logger.hpp"
 
 
 using namespace std;
@@ -15,18 +18,13 @@ using namespace std;
 // detects objects in an image using the YOLO library and a set of pre-trained objects from the COCO database;
 // a set of 80 classes is listed in "coco.names" and pre-trained weights are stored in "yolov3.weights"
 void detectObjects(cv::Mat& img, std::vector<BoundingBox>& bBoxes, float confThreshold, float nmsThreshold, 
-                   std::string basePath, std::string classesFile, std::string modelConfiguration, std::string modelWeights, bool bVis, std::string imgTitle)
+                   std::string basePath, std::string classesFile, std::string modelConfiguration, std::string modelWeights, bool bVis, std::string imgTitle,
+                   cv::Mat *detectorInput, const DetectorInputTransform *inputTransform)
 {
-    // load class names from file
-    vector<string> classes;
-    ifstream ifs(classesFile.c_str());
-    string line;
-    while (getline(ifs, line)) classes.push_back(line);
-    
-    // load neural network
-    cv::dnn::Net net = cv::dnn::readNetFromDarknet(modelConfiguration, modelWeights);
-    net.setPreferableBackend(cv::dnn::DNN_BACKEND_OPENCV);
-    net.setPreferableTarget(cv::dnn::DNN_TARGET_CPU);
+    // class names and neural network are loaded on the first call only
+    DetectorModel &model = loadDetectorModel(classesFile, modelConfiguration, modelWeights);
+    cv::dnn::Net &net = model.net;
+    const vector<string> &classes = model.classes;
     
     // generate 4D blob from input image
     cv::Mat blob;
@@ -36,20 +34,27 @@ void detectObjects(cv::Mat& img, std::vector<BoundingBox>& bBoxes, float confThr
     cv::Scalar mean = cv::Scalar(0,0,0);
     bool swapRB = false;
     bool crop = false;
-    cv::dnn::blobFromImage(img, blob, scalefactor, size, mean, swapRB, crop);
-    
-    // Get names of output layers
-    vector<cv::String> names;
-    vector<int> outLayers = net.getUnconnectedOutLayers(); // get  indices of  output layers, i.e.  layers with unconnected outputs
-    vector<cv::String> layersNames = net.getLayerNames(); // get  names of all layers in the network
-    
-    names.resize(outLayers.size());
-    for (size_t i = 0; i < outLayers.size(); ++i) // Get the names of the output layers in names
-        names[i] = layersNames[outLayers[i] - 1];
+    if (detectorInput != nullptr)
+        cv::dnn::blobFromImage(*detectorInput, blob, scalefactor, detectorInput->size(), mean, swapRB, crop); // already resized during preprocessing
+    else
+        cv::dnn::blobFromImage(img, blob, scalefactor, size, mean, swapRB, crop);
     
-    // invoke forward propagation through network
-    net.setInput(blob);
-    net.forward(netOutput, names);
+    // invoke forward propagation through network; sessions on other threads share the net and take turns
+    {
+        lock_guard<mutex> lock(model.forwardMutex);
+        double t = (double)cv::getTickCount();
+        net.setInput(blob);
+        net.forward(netOutput, model.outputNames);
+
+        // the first pass also allocates the layer buffers, it completes the startup cost of the detector
+        if (!model.bForwarded)
+        {
+            double forwardTime = 1000.0 * ((double)cv::getTickCount() - t) / cv::getTickFrequency();
+            LOG_INFO << "First detection after " << model.loadTime + forwardTime << " ms (loading " << model.loadTime << " ms, first forward pass "
+                     << forwardTime << " ms)";
+            model.bForwarded = true;
+        }
+    }
     
     // Scan through all bounding boxes and keep only the ones with high confidence
     vector<int> classIds; vector<float> confidences; vector<cv::Rect> boxes;
@@ -67,10 +72,22 @@ void detectObjects(cv::Mat& img, std::vector<BoundingBox>& bBoxes, float confThr
             if (confidence > confThreshold)
             {
                 cv::Rect box; int cx, cy;
-                cx = (int)(data[0] * img.cols);
-                cy = (int)(data[1] * img.rows);
-                box.width = (int)(data[2] * img.cols);
-                box.height = (int)(data[3] * img.rows);
+                if (detectorInput != nullptr && inputTransform != nullptr)
+                {
+                    // network output is relative to the detector input, map it back through crop, scale and letterbox
+                    const DetectorInputTransform &tf = *inputTransform;
+                    cx = (int)(tf.roi.x + (data[0] * detectorInput->cols - tf.pad.x) / tf.scaleX);
+                    cy = (int)(tf.roi.y + (data[1] * detectorInput->rows - tf.pad.y) / tf.scaleY);
+                    box.width = (int)(data[2] * detectorInput->cols / tf.scaleX);
+                    box.height = (int)(data[3] * detectorInput->rows / tf.scaleY);
+                }
+                else
+                {
+                    cx = (int)(data[0] * img.cols);
+                    cy = (int)(data[1] * img.rows);
+                    box.width = (int)(data[2] * img.cols);
+                    box.height = (int)(data[3] * img.rows);
+                }
                 box.x = cx - box.width/2; // left
                 box.y = cy - box.height/2; // top
                 
@@ -91,10 +108,14 @@ void detectObjects(cv::Mat& img, std::vector<BoundingBox>& bBoxes, float confThr
         bBox.classID = classIds[*it];
         bBox.confidence = confidences[*it];
         bBox.boxID = (int)bBoxes.size(); // zero-based unique identifier for this bounding box
+        bBox.motion = cv::Point2f(0, 0); // unknown until the box has been matched to the previous frame
        
         bBoxes.push_back(bBox);
     }
     
+    if (!bVis && imgTitle.empty()) // neither shown nor saved
+        return;
+
     // show results
     cv::Mat visImg = img.clone();
     for(auto it=bBoxes.begin(); it!=bBoxes.end(); ++it) {
@@ -135,11 +156,28 @@ void detectObjects(cv::Mat& img, std::vector<BoundingBox>& bBoxes, float confThr
         }
         catch (const cv::Exception& ex)
         {
-            std::cout << "Exception converting image in detectObjects: " << ex.what() << std::endl;
+            LOG_ERROR << "Exception converting image in detectObjects: " << ex.what();
         }
         if (result)
-            std::cout << "Saved JPG file in detectObjects." << std::endl;
+            LOG_INFO << "Saved JPG file in detectObjects.";
         else
-            std::cout << "ERROR: Couldn't save image in detectObjects." << std::endl;
+            LOG_ERROR << "Couldn't save image in detectObjects.";
+    }
+}
+
+
+// The vehicle ahead is the largest (i.e. closest) car, bus or truck whose bottom centre lies within the image region of the ego lane
+int findVehicleAhead(const std::vector<BoundingBox> &bBoxes, const cv::Rect &egoLane)
+{
+    const int car = 2, bus = 5, truck = 7; // COCO class IDs
+    int vehicleAhead = -1;
+    for (size_t i = 0; i < bBoxes.size(); ++i)
+    {
+        const BoundingBox &box = bBoxes[i];
+        bool bVehicle = box.classID == car || box.classID == bus || box.classID == truck;
+        cv::Point bottomCentre(box.roi.x + box.roi.width / 2, box.roi.y + box.roi.height - 1);
+        if (bVehicle && egoLane.contains(bottomCentre) && (vehicleAhead < 0 || box.roi.area() > bBoxes[vehicleAhead].roi.area()))
+            vehicleAhead = (int)i;
     }
+    return vehicleAhead;
 }
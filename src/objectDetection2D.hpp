@@ -8,6 +8,8 @@
 #include "dataStructures.h"
 
 void detectObjects(cv::Mat& img, std::vector<BoundingBox>& bBoxes, float confThreshold, float nmsThreshold, 
-                   std::string basePath, std::string classesFile, std::string modelConfiguration, std::string modelWeights, bool bVis, std::string imgTitle);
+                   std::string basePath, std::string classesFile, std::string modelConfiguration, std::string modelWeights, bool bVis, std::string imgTitle,
+                   cv::Mat *detectorInput=nullptr, const DetectorInputTransform *inputTransform=nullptr);
+int findVehicleAhead(const std::vector<BoundingBox> &bBoxes, const cv::Rect &egoLane); // position of the box or -1
 
 #endif /* objectDetection2D_hpp */
@@ -0,0 +1,173 @@
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <random>
+#include <cmath>
+
+#include "parameterSearch.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+
+// Draw numCandidates distinct configurations from the parameter space (all of them if the space is smaller)
+void sampleCandidates(const ParameterSpace &space, int numCandidates, unsigned int seed, std::vector<SearchCandidate> &candidates)
+{
+    vector<SearchCandidate> all;
+    for (const auto &combination : space.combinations)
+    {
+        bool bFast = combination.first.compare("FAST") == 0;
+        vector<int> fastThresholds = bFast ? space.fastThresholds : vector<int>(1, ExperimentConfig().fastThreshold);
+
+        for (int fastThreshold : fastThresholds)
+            for (float maxDescDistRatio : space.maxDescDistRatios)
+                for (float shrinkFactor : space.shrinkFactors)
+                    for (int lidarNthPoint : space.lidarNthPoints)
+                        for (float confThreshold : space.confThresholds)
+                        {
+                            SearchCandidate candidate;
+                            candidate.detectorType = combination.first;
+                            candidate.descriptorType = combination.second;
+                            candidate.config.fastThreshold = fastThreshold;
+                            candidate.config.maxDescDistRatio = maxDescDistRatio;
+                            candidate.config.shrinkFactor = shrinkFactor;
+                            candidate.config.lidarNthPoint = lidarNthPoint;
+                            candidate.config.confThreshold = confThreshold;
+                            candidate.lastImg = 0;
+                            candidate.cost = 0.0;
+                            all.push_back(candidate);
+                        }
+    }
+
+    // fixed seed, so a search can be repeated
+    mt19937 rng(seed);
+    shuffle(all.begin(), all.end(), rng);
+    if ((int)all.size() > numCandidates)
+        all.resize(numCandidates);
+
+    LOG_INFO << "Sampled " << all.size() << " configurations from the parameter space";
+    candidates = all;
+}
+
+
+static bool isValidTTC(double ttc)
+{
+    return std::isfinite(ttc) && ttc > 0.0 && ttc < 100.0;
+}
+
+
+// Per-frame summary of the results of one frame : the smallest valid TTC of all boxes (the most imminent collision, NAN if no
+// box has one) and the processing time of the frame
+struct FrameCost {
+
+    double ttc[2]; // camera, Lidar
+    double processingTime;
+};
+
+
+// Cost of a run over numFrames frames, lower is better. The results (one per matched box) are first reduced to one entry
+// per frame, then it adds
+//  - the mean frame-to-frame change of the camera and Lidar TTC in [s] (the true TTC only changes slowly),
+//  - a penalty of 10 s for each frame without a valid TTC estimate, relative to the no. of frames,
+//  - the mean processing time per frame in [ms], weighted by latencyWeight.
+double experimentCost(const std::vector<ExperimentResult> &results, int numFrames, double latencyWeight)
+{
+    const double invalidPenalty = 10.0;
+
+    // results are appended frame by frame, so the boxes of a frame are adjacent
+    vector<FrameCost> frames;
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const ExperimentResult &result = results[i];
+        if (i == 0 || result.imgID != results[i - 1].imgID)
+            frames.push_back(FrameCost{{NAN, NAN}, 0.0});
+
+        FrameCost &frame = frames.back();
+        double ttcs[2] = {result.ttcCamera, result.ttcLidar};
+        for (int sensor = 0; sensor < 2; ++sensor)
+        {
+            if (isValidTTC(ttcs[sensor]) && !(frame.ttc[sensor] <= ttcs[sensor])) // NAN compares false
+                frame.ttc[sensor] = ttcs[sensor];
+        }
+        frame.processingTime = max(frame.processingTime, result.processingTime);
+    }
+
+    double cost = 0.0;
+    for (int sensor = 0; sensor < 2; ++sensor)
+    {
+        double prevTTC = NAN, sumChange = 0.0;
+        int numValid = 0, numChanges = 0;
+        for (const auto &frame : frames)
+        {
+            double ttc = frame.ttc[sensor];
+            if (std::isnan(ttc))
+                continue;
+            if (!std::isnan(prevTTC))
+            {
+                sumChange += fabs(ttc - prevTTC);
+                numChanges++;
+            }
+            prevTTC = ttc;
+            numValid++;
+        }
+
+        cost += numChanges > 0 ? sumChange / numChanges : 0.0;
+        cost += invalidPenalty * max(numFrames - numValid, 0) / max(numFrames, 1);
+    }
+
+    double sumTime = 0.0;
+    for (const auto &frame : frames)
+        sumTime += frame.processingTime;
+    cost += latencyWeight * (frames.empty() ? 0.0 : sumTime / frames.size());
+
+    return cost;
+}
+
+
+std::string describeCandidate(const SearchCandidate &candidate)
+{
+    ostringstream ss;
+    ss << std::fixed << std::setprecision(2) << candidate.detectorType << "/" << candidate.descriptorType;
+    if (candidate.detectorType.compare("FAST") == 0)
+        ss << " fastThreshold=" << candidate.config.fastThreshold;
+    ss << " maxDescDistRatio=" << candidate.config.maxDescDistRatio << " shrinkFactor=" << candidate.config.shrinkFactor
+       << " lidarNthPoint=" << candidate.config.lidarNthPoint << " confThreshold=" << candidate.config.confThreshold;
+    return ss.str();
+}
+
+
+// Successive halving: all candidates run on the first minFrames frames, then only the best 1/eta of them continue on eta times
+// as many frames, until the survivors have run up to image maxImg. A promoted candidate resumes after its last frame instead of
+// starting over. On return, candidates holds the last round's survivors ordered by cost.
+void successiveHalving(std::vector<SearchCandidate> &candidates, int minFrames, int maxImg, int eta, double latencyWeight, CandidateEvaluator evaluate)
+{
+    int budget = max(minFrames, 2);
+    eta = max(eta, 2);
+
+    for (int round = 0; !candidates.empty(); ++round)
+    {
+        int toImg = min(budget, maxImg);
+        LOG_INFO << "Search round " << round << ": " << candidates.size() << " configurations up to image " << toImg;
+
+        for (auto &candidate : candidates)
+        {
+            if (candidate.lastImg >= toImg)
+                continue;
+            evaluate(candidate, candidate.lastImg, toImg, candidate.results); // the last evaluated frame serves as previous frame
+            candidate.lastImg = toImg;
+            candidate.cost = experimentCost(candidate.results, toImg, latencyWeight);
+        }
+
+        stable_sort(candidates.begin(), candidates.end(), [](const SearchCandidate &a, const SearchCandidate &b) { return a.cost < b.cost; });
+        for (const auto &candidate : candidates)
+            LOG_INFO << "    cost " << std::fixed << std::setprecision(3) << candidate.cost << " : " << describeCandidate(candidate);
+
+        if (toImg >= maxImg)
+            break;
+
+        candidates.resize(max((int)candidates.size() / eta, 1));
+        budget *= eta;
+    }
+}
@@ -0,0 +1,39 @@
+
+#ifndef parameterSearch_hpp
+#define parameterSearch_hpp
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+#include <functional>
+
+#include "dataStructures.h"
+
+struct ParameterSpace { // values tried for each tunable parameter of ExperimentConfig
+
+    std::vector<std::pair<std::string, std::string>> combinations; // detector/descriptor pairs
+    std::vector<int> fastThresholds; // only varied for the FAST detector
+    std::vector<float> maxDescDistRatios;
+    std::vector<float> shrinkFactors;
+    std::vector<int> lidarNthPoints;
+    std::vector<float> confThresholds;
+};
+
+struct SearchCandidate { // one configuration of the search and its results so far
+
+    std::string detectorType, descriptorType;
+    ExperimentConfig config;
+    int lastImg; // results cover the frames up to this image no.
+    std::vector<ExperimentResult> results;
+    double cost;
+};
+
+// runs the experiment of a candidate on the frames fromImg...toImg and appends its results
+typedef std::function<void(const SearchCandidate &candidate, int fromImg, int toImg, std::vector<ExperimentResult> &results)> CandidateEvaluator;
+
+void sampleCandidates(const ParameterSpace &space, int numCandidates, unsigned int seed, std::vector<SearchCandidate> &candidates);
+double experimentCost(const std::vector<ExperimentResult> &results, int numFrames, double latencyWeight);
+void successiveHalving(std::vector<SearchCandidate> &candidates, int minFrames, int maxImg, int eta, double latencyWeight, CandidateEvaluator evaluate);
+std::string describeCandidate(const SearchCandidate &candidate);
+
+#endif /* parameterSearch_hpp */
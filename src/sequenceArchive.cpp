@@ -0,0 +1,282 @@
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <opencv2/highgui/highgui.hpp>
+
+#include "sequenceArchive.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+static const char archiveMagic[8] = {'K', 'S', 'E', 'Q', 'A', 'R', 'C', '1'};
+
+
+SequenceArchiveWriter::SequenceArchiveWriter(std::string filename, bool bCompressImages, float lidarScale)
+    : bWriteFailed(false), position(0)
+{
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, archiveMagic, sizeof(archiveMagic));
+    header.imageEncoding = bCompressImages ? 1 : 0;
+    header.lidarScale = lidarScale;
+
+    file = fopen(filename.c_str(), "wb");
+    if (file == nullptr)
+    {
+        LOG_ERROR << "Couldn't create sequence archive " << filename;
+        return;
+    }
+
+    // header is rewritten with the final frame count and index position on close
+    write(&header, sizeof(header));
+}
+
+
+SequenceArchiveWriter::~SequenceArchiveWriter()
+{
+    close();
+}
+
+
+void SequenceArchiveWriter::write(const void *buffer, size_t bytes)
+{
+    if (bWriteFailed)
+        return;
+    size_t written = fwrite(buffer, 1, bytes, file);
+    position += written;
+    bWriteFailed = written != bytes;
+}
+
+
+// pad the file so that the next block starts at a multiple of the given alignment
+void SequenceArchiveWriter::alignTo(uint64_t alignment)
+{
+    static const char zeros[64] = {0};
+    uint64_t padding = (alignment - position % alignment) % alignment;
+    write(zeros, padding);
+}
+
+
+bool SequenceArchiveWriter::addFrame(int frameNumber, SensorFrame &frame)
+{
+    if (file == nullptr || bWriteFailed)
+        return false;
+    if (frame.cameraImg.empty())
+    {
+        LOG_ERROR << "Frame " << frameNumber << " has no image, not adding it to the sequence archive";
+        return false;
+    }
+
+    ArchiveFrameEntry entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.frameNumber = frameNumber;
+    entry.imgRows = frame.cameraImg.rows;
+    entry.imgCols = frame.cameraImg.cols;
+    entry.imgType = frame.cameraImg.type();
+
+    // image planes are cache-line aligned so that they can be used in place from the mapping
+    alignTo(64);
+    entry.imgOffset = position;
+    if (header.imageEncoding == 1)
+    {
+        vector<uchar> png;
+        vector<int> params = {cv::IMWRITE_PNG_COMPRESSION, 1};
+        if (!cv::imencode(".png", frame.cameraImg, png, params))
+        {
+            LOG_ERROR << "Couldn't encode the image of frame " << frameNumber;
+            return false;
+        }
+        write(png.data(), png.size());
+    }
+    else
+    {
+        cv::Mat img = frame.cameraImg.isContinuous() ? frame.cameraImg : frame.cameraImg.clone();
+        write(img.data, img.total() * img.elemSize());
+    }
+    entry.imgBytes = position - entry.imgOffset;
+
+    // quantize Lidar points, the archive is expected to hold cropped points only so the int16 range is sufficient
+    LidarPointCloud &lp = frame.lidarPoints;
+    vector<QuantizedLidarPoint> quantized(lp.size());
+    for (size_t i = 0; i < lp.size(); ++i)
+    {
+        QuantizedLidarPoint &qp = quantized[i];
+        qp.x = (int16_t)max(-32768.0f, min(32767.0f, roundf(lp.x[i] / header.lidarScale)));
+        qp.y = (int16_t)max(-32768.0f, min(32767.0f, roundf(lp.y[i] / header.lidarScale)));
+        qp.z = (int16_t)max(-32768.0f, min(32767.0f, roundf(lp.z[i] / header.lidarScale)));
+        qp.r = (uint16_t)max(0.0f, min(65535.0f, roundf(lp.r[i] * 65535.0f)));
+    }
+
+    alignTo(8);
+    entry.lidarOffset = position;
+    entry.numLidarPoints = (uint32_t)quantized.size();
+    write(quantized.data(), quantized.size() * sizeof(QuantizedLidarPoint));
+    if (bWriteFailed)
+    {
+        LOG_ERROR << "Couldn't write frame " << frameNumber << " to the sequence archive";
+        return false;
+    }
+
+    index.push_back(entry);
+    return true;
+}
+
+
+bool SequenceArchiveWriter::close()
+{
+    if (file == nullptr)
+        return !bWriteFailed;
+
+    // frames are looked up by binary search over their numbers
+    std::sort(index.begin(), index.end(), [](const ArchiveFrameEntry &a, const ArchiveFrameEntry &b) { return a.frameNumber < b.frameNumber; });
+
+    alignTo(8);
+    header.indexOffset = position;
+    header.numFrames = (uint32_t)index.size();
+    write(index.data(), index.size() * sizeof(ArchiveFrameEntry));
+
+    if (!bWriteFailed && fseek(file, 0, SEEK_SET) != 0)
+        bWriteFailed = true;
+    write(&header, sizeof(header));
+    if (fclose(file) != 0)
+        bWriteFailed = true;
+    file = nullptr;
+
+    if (bWriteFailed)
+        LOG_ERROR << "Couldn't write the sequence archive";
+    return !bWriteFailed;
+}
+
+
+SequenceArchive::SequenceArchive()
+    : data(nullptr), size(0), index(nullptr)
+{
+    memset(&header, 0, sizeof(header));
+}
+
+
+SequenceArchive::~SequenceArchive()
+{
+    if (data != nullptr)
+        munmap(data, size);
+}
+
+
+bool SequenceArchive::open(std::string filename)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        LOG_ERROR << "Couldn't open sequence archive " << filename;
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        LOG_ERROR << "Couldn't read the size of sequence archive " << filename;
+        ::close(fd);
+        return false;
+    }
+    size = st.st_size;
+
+    // private writable mapping : pages are shared through the page cache, stray writes to images only create private copies
+    void *mapping = size >= sizeof(ArchiveHeader) ? mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    ::close(fd);
+    if (mapping == MAP_FAILED)
+    {
+        LOG_ERROR << "Couldn't map sequence archive " << filename;
+        return false;
+    }
+    data = (unsigned char *)mapping;
+
+    memcpy(&header, data, sizeof(header));
+    bool bValid = memcmp(header.magic, archiveMagic, sizeof(archiveMagic)) == 0 && header.indexOffset % 8 == 0 &&
+                  fitsInMapping(header.indexOffset, 0) && header.numFrames <= (size - header.indexOffset) / sizeof(ArchiveFrameEntry);
+    if (bValid)
+    {
+        // every entry is checked once here, readFrame relies on it
+        index = (const ArchiveFrameEntry *)(data + header.indexOffset);
+        for (uint32_t i = 0; i < header.numFrames && bValid; ++i)
+            bValid = isValidEntry(index[i]);
+    }
+
+    if (!bValid)
+    {
+        LOG_ERROR << filename << " is not a valid sequence archive";
+        munmap(data, size);
+        data = nullptr;
+        index = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+
+// Whether bytes at offset lie within the mapping, without overflowing
+bool SequenceArchive::fitsInMapping(uint64_t offset, uint64_t bytes) const
+{
+    return offset <= size && bytes <= size - offset;
+}
+
+
+bool SequenceArchive::isValidEntry(const ArchiveFrameEntry &entry) const
+{
+    if (!fitsInMapping(entry.imgOffset, entry.imgBytes) || entry.lidarOffset % alignof(QuantizedLidarPoint) != 0 ||
+        !fitsInMapping(entry.lidarOffset, (uint64_t)entry.numLidarPoints * sizeof(QuantizedLidarPoint)))
+        return false;
+
+    if (header.imageEncoding == 1)
+        return entry.imgBytes > 0 && entry.imgBytes <= (uint64_t)numeric_limits<int>::max(); // decoded from a 1 x imgBytes Mat
+
+    // raw planes are used in place : 8-bit images whose pixels lie within the image data
+    int channels = entry.imgType == CV_8UC3 ? 3 : (entry.imgType == CV_8UC1 ? 1 : 0);
+    int maxSide = 1 << 16;
+    return channels > 0 && entry.imgRows > 0 && entry.imgRows <= maxSide && entry.imgCols > 0 && entry.imgCols <= maxSide &&
+           (uint64_t)entry.imgRows * entry.imgCols * channels <= entry.imgBytes;
+}
+
+
+int SequenceArchive::findFrame(int frameNumber) const
+{
+    const ArchiveFrameEntry *last = index + header.numFrames;
+    const ArchiveFrameEntry *entry = lower_bound(index, last, frameNumber,
+                                                 [](const ArchiveFrameEntry &e, int number) { return e.frameNumber < number; });
+    return (entry != last && entry->frameNumber == frameNumber) ? (int)(entry - index) : -1;
+}
+
+
+void SequenceArchive::readFrame(int position, SensorFrame &frame) const
+{
+    const ArchiveFrameEntry &entry = index[position];
+
+    ostringstream imgNumber;
+    imgNumber << setfill('0') << setw(4) << entry.frameNumber;
+    frame.imgFile = imgNumber.str();
+    frame.imgFullFilename = "archive frame " + imgNumber.str();
+
+    // raw planes are used in place from the mapping, compressed images are decoded
+    if (header.imageEncoding == 1)
+        frame.cameraImg = cv::imdecode(cv::Mat(1, (int)entry.imgBytes, CV_8UC1, data + entry.imgOffset), cv::IMREAD_COLOR);
+    else
+        frame.cameraImg = cv::Mat(entry.imgRows, entry.imgCols, entry.imgType, data + entry.imgOffset);
+
+    const QuantizedLidarPoint *qp = (const QuantizedLidarPoint *)(data + entry.lidarOffset);
+    frame.lidarPoints.resize(entry.numLidarPoints);
+    for (uint32_t i = 0; i < entry.numLidarPoints; ++i)
+    {
+        frame.lidarPoints.x[i] = qp[i].x * header.lidarScale;
+        frame.lidarPoints.y[i] = qp[i].y * header.lidarScale;
+        frame.lidarPoints.z[i] = qp[i].z * header.lidarScale;
+        frame.lidarPoints.r[i] = qp[i].r / 65535.0f;
+    }
+}
@@ -0,0 +1,85 @@
+
+#ifndef sequenceArchive_hpp
+#define sequenceArchive_hpp
+
+#include <stdio.h>
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <opencv2/core.hpp>
+
+#include "dataStructures.h"
+#include "framePrefetch.hpp"
+
+// On-disk layout : header | image planes and Lidar points of all frames | frame index
+struct ArchiveHeader {
+
+    char magic[8]; // "KSEQARC1"
+    uint32_t numFrames;
+    uint32_t imageEncoding; // 0 = raw pixel planes, 1 = PNG with low compression level
+    float lidarScale; // size of one quantization step of Lidar coordinates in [m]
+    uint32_t reserved;
+    uint64_t indexOffset; // file position of the frame index
+};
+
+struct ArchiveFrameEntry {
+
+    int32_t frameNumber; // KITTI frame number the entry has been created from
+    int32_t imgRows, imgCols, imgType;
+    uint64_t imgOffset, imgBytes; // position and size of the image data
+    uint64_t lidarOffset; // position of the quantized Lidar points
+    uint32_t numLidarPoints;
+    uint32_t reserved;
+};
+
+struct QuantizedLidarPoint {
+
+    int16_t x, y, z; // coordinates in multiples of lidarScale
+    uint16_t r; // reflectivity scaled to [0, 65535]
+};
+
+// Writes frames one after another into a single archive file; once a write has failed, all further calls fail
+class SequenceArchiveWriter
+{
+public:
+    SequenceArchiveWriter(std::string filename, bool bCompressImages, float lidarScale);
+    ~SequenceArchiveWriter();
+
+    bool isOpen() const { return file != nullptr; }
+    bool addFrame(int frameNumber, SensorFrame &frame); // false if the frame has no image or couldn't be written
+    bool close(); // writes the frame index, no frames can be added afterwards; false if anything couldn't be written
+
+private:
+    void write(const void *buffer, size_t bytes);
+    void alignTo(uint64_t alignment);
+
+    FILE *file;
+    bool bWriteFailed;
+    ArchiveHeader header;
+    std::vector<ArchiveFrameEntry> index;
+    uint64_t position;
+};
+
+// Memory-maps an archive and gives random access to its frames, safe to use from several threads
+class SequenceArchive
+{
+public:
+    SequenceArchive();
+    ~SequenceArchive();
+
+    bool open(std::string filename);
+    int numFrames() const { return (int)header.numFrames; }
+    int findFrame(int frameNumber) const; // position of a frame in the archive or -1
+    void readFrame(int position, SensorFrame &frame) const;
+
+private:
+    bool fitsInMapping(uint64_t offset, uint64_t bytes) const;
+    bool isValidEntry(const ArchiveFrameEntry &entry) const;
+
+    unsigned char *data;
+    size_t size;
+    ArchiveHeader header;
+    const ArchiveFrameEntry *index;
+};
+
+#endif /* sequenceArchive_hpp */
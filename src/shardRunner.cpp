@@ -0,0 +1,259 @@
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <deque>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "shardRunner.hpp"
+#include "logger.hpp"
+
+using namespace std;
+
+
+static bool fileExists(string fileName)
+{
+    ifstream file(fileName);
+    return file.good();
+}
+
+
+// Number of consecutive camera images of a sequence, counted from image 0
+int countSequenceFrames(std::string dataPath, std::string sequence)
+{
+    int numFrames = 0;
+    while (true)
+    {
+        ostringstream imgFile;
+        imgFile << dataPath << "images/" << sequence << "/image_02/data/" << setfill('0') << setw(10) << numFrames << ".png";
+        if (!fileExists(imgFile.str()))
+            return numFrames;
+        numFrames++;
+    }
+}
+
+
+// Split every sequence into frame ranges and combine each range with every detector/descriptor combination.
+// Consecutive ranges share one frame because the first frame of a range produces no TTC.
+void planShards(std::string dataPath, const std::vector<std::string> &sequences, const std::vector<std::pair<std::string, std::string>> &combinations,
+                int framesPerShard, std::vector<ShardSpec> &shards)
+{
+    shards.clear();
+    for (const auto &sequence : sequences)
+    {
+        int numFrames = countSequenceFrames(dataPath, sequence);
+        if (numFrames < 2)
+        {
+            LOG_INFO << "Skipping sequence " << sequence << " with " << numFrames << " frames";
+            continue;
+        }
+
+        for (const auto &combination : combinations)
+        {
+            for (int first = 0; first < numFrames - 1; first += framesPerShard)
+            {
+                ShardSpec shard;
+                shard.shardID = (int)shards.size();
+                shard.sequence = sequence;
+                shard.detectorType = combination.first;
+                shard.descriptorType = combination.second;
+                shard.firstImg = first;
+                shard.lastImg = min(first + framesPerShard, numFrames - 1);
+                shards.push_back(shard);
+            }
+        }
+    }
+}
+
+
+// Write the plan under a temporary name first, so that an interrupted coordinator leaves either no plan or a complete one
+bool writeShardPlan(std::string workDir, const std::vector<ShardSpec> &shards)
+{
+    string fileName = workDir + "/shards.txt";
+    string tmpFileName = fileName + ".tmp";
+    {
+        ofstream file(tmpFileName);
+        for (const auto &shard : shards)
+            file << shard.shardID << " " << shard.sequence << " " << shard.detectorType << " " << shard.descriptorType << " " << shard.firstImg << " " << shard.lastImg << endl;
+
+        if (!file)
+        {
+            LOG_ERROR << "Couldn't write shard plan to " << workDir;
+            return false;
+        }
+    }
+
+    if (rename(tmpFileName.c_str(), fileName.c_str()) != 0)
+    {
+        LOG_ERROR << "Couldn't write shard plan to " << workDir;
+        return false;
+    }
+    return true;
+}
+
+
+bool readShardPlan(std::string workDir, std::vector<ShardSpec> &shards)
+{
+    ifstream file(workDir + "/shards.txt");
+    if (!file)
+        return false;
+
+    shards.clear();
+    ShardSpec shard;
+    while (file >> shard.shardID >> shard.sequence >> shard.detectorType >> shard.descriptorType >> shard.firstImg >> shard.lastImg)
+        shards.push_back(shard);
+    return true;
+}
+
+
+std::string shardResultFile(std::string workDir, int shardID)
+{
+    return workDir + "/shard_" + to_string(shardID) + ".csv";
+}
+
+
+// Write the results of a finished shard; the file only appears under its final name once it is complete,
+// so its existence marks the shard as done
+bool writeShardResult(std::string workDir, const ShardSpec &shard, std::map<std::string, std::vector<ExperimentResult>> &result)
+{
+    string fileName = shardResultFile(workDir, shard.shardID);
+    string tmpFileName = fileName + ".tmp";
+    {
+        ofstream file(tmpFileName);
+        file << std::fixed << std::setprecision(3);
+        for (auto &test : result)
+        {
+            for (auto &item : test.second)
+            {
+                file << shard.sequence << ", " << item.detectorType << ", " << item.descriptorType << ", " << item.imgID << ", " << item.ttcLidar << ", "
+                     << item.ttcCamera << ", " << item.numOfKeypointsDetected << ", " << item.numOfKeypointsMatched << ", " << item.processingTime << ", "
+                     << item.frameBufferBytes << ", " << item.numAllocations << ", " << item.bytesAllocated << ", " << item.peakResidentBytes << endl;
+            }
+        }
+
+        if (!file)
+        {
+            LOG_ERROR << "Couldn't write shard result " << tmpFileName;
+            return false;
+        }
+    }
+
+    return rename(tmpFileName.c_str(), fileName.c_str()) == 0;
+}
+
+
+// Run all unfinished shards on up to numWorkers worker processes (this program started with -shard <workDir> <shardID>).
+// Shards whose worker crashes or fails are retried up to maxAttempts times; returns the no. of shards which failed.
+int runShards(std::string workDir, std::string executable, const std::vector<ShardSpec> &shards, int numWorkers, int maxAttempts)
+{
+    deque<int> pending;
+    for (const auto &shard : shards)
+    {
+        if (fileExists(shardResultFile(workDir, shard.shardID)))
+            LOG_INFO << "Shard " << shard.shardID << " already finished";
+        else
+            pending.push_back(shard.shardID);
+    }
+
+    map<pid_t, int> running; // worker process -> shard
+    map<int, int> attempts;
+    int numFailed = 0;
+
+    while (!pending.empty() || !running.empty())
+    {
+        // keep all workers busy
+        while ((int)running.size() < numWorkers && !pending.empty())
+        {
+            int shardID = pending.front();
+            pending.pop_front();
+            attempts[shardID]++;
+
+            string shardArg = to_string(shardID);
+            string logFile = workDir + "/shard_" + shardArg + ".log";
+
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                // worker: log to the shard's file and replace this process by a fresh instance of the program
+                int fd = open(logFile.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+                if (fd >= 0)
+                {
+                    dup2(fd, STDOUT_FILENO);
+                    dup2(fd, STDERR_FILENO);
+                }
+                execl(executable.c_str(), executable.c_str(), "-shard", workDir.c_str(), shardArg.c_str(), (char *)nullptr);
+                _exit(127);
+            }
+            if (pid < 0)
+            {
+                LOG_ERROR << "Couldn't start worker for shard " << shardID;
+                numFailed++;
+                continue;
+            }
+
+            running[pid] = shardID;
+            LOG_INFO << "Started shard " << shardID << " (attempt " << attempts[shardID] << ") as process " << pid;
+        }
+
+        if (running.empty())
+            break;
+
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0)
+            break;
+
+        auto worker = running.find(pid);
+        if (worker == running.end())
+            continue;
+        int shardID = worker->second;
+        running.erase(worker);
+
+        bool bDone = WIFEXITED(status) && WEXITSTATUS(status) == 0 && fileExists(shardResultFile(workDir, shardID));
+        if (bDone)
+        {
+            LOG_INFO << "Finished shard " << shardID;
+        }
+        else if (attempts[shardID] < maxAttempts)
+        {
+            LOG_WARN << "Worker of shard " << shardID << (WIFSIGNALED(status) ? " crashed" : " failed") << ", retrying";
+            pending.push_back(shardID);
+        }
+        else
+        {
+            LOG_ERROR << "Shard " << shardID << " failed " << attempts[shardID] << " times, see " << workDir << "/shard_" << shardID << ".log";
+            numFailed++;
+        }
+    }
+
+    return numFailed;
+}
+
+
+// Concatenate the shard results in plan order, so the merged file does not depend on which worker finished first
+bool mergeShardResults(std::string workDir, const std::vector<ShardSpec> &shards, std::string mergedFile)
+{
+    ofstream merged(mergedFile);
+    merged << "sequence, detector_type, descriptor_type, img_id, lidar_ttc, camera_ttc, num_kpts, num_kpts_matched, processing_time, buffer_bytes, num_allocs, alloc_bytes, peak_rss_bytes" << endl;
+
+    bool bComplete = true;
+    for (const auto &shard : shards)
+    {
+        ifstream file(shardResultFile(workDir, shard.shardID));
+        if (!file)
+        {
+            LOG_INFO << "Missing result of shard " << shard.shardID << " in merge";
+            bComplete = false;
+            continue;
+        }
+        if (file.peek() != EOF) // streaming an empty buffer would set the failbit of the merged file
+            merged << file.rdbuf();
+    }
+
+    LOG_INFO << "Merged " << shards.size() << " shards into " << mergedFile << (bComplete ? "" : " (incomplete)");
+    return bComplete && (bool)merged;
+}
@@ -0,0 +1,32 @@
+
+#ifndef shardRunner_hpp
+#define shardRunner_hpp
+
+#include <stdio.h>
+#include <vector>
+#include <map>
+#include <string>
+
+#include "dataStructures.h"
+
+struct ShardSpec { // one unit of work of a sharded run: a frame range of one sequence with one detector/descriptor combination
+
+    int shardID; // position in the shard plan, also determines the order of the merged results
+    std::string sequence; // KITTI drive, e.g. "KITTI/2011_09_26"
+    std::string detectorType, descriptorType;
+    int firstImg, lastImg; // frame range, the first frame only serves as previous frame for TTC
+};
+
+int countSequenceFrames(std::string dataPath, std::string sequence);
+void planShards(std::string dataPath, const std::vector<std::string> &sequences, const std::vector<std::pair<std::string, std::string>> &combinations,
+                int framesPerShard, std::vector<ShardSpec> &shards);
+bool writeShardPlan(std::string workDir, const std::vector<ShardSpec> &shards);
+bool readShardPlan(std::string workDir, std::vector<ShardSpec> &shards);
+
+std::string shardResultFile(std::string workDir, int shardID);
+bool writeShardResult(std::string workDir, const ShardSpec &shard, std::map<std::string, std::vector<ExperimentResult>> &result);
+
+int runShards(std::string workDir, std::string executable, const std::vector<ShardSpec> &shards, int numWorkers, int maxAttempts);
+bool mergeShardResults(std::string workDir, const std::vector<ShardSpec> &shards, std::string mergedFile);
+
+#endif /* shardRunner_hpp */
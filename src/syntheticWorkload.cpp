@@ -0,0 +1,218 @@
+
+#include <cmath>
+#include <random>
+#include <algorithm>
+
+#include "syntheticWorkload.hpp"
+
+using namespace std;
+
+// rear surface of a vehicle in m, heights relative to the Lidar (mounted 1.73 m above the road)
+static const double vehicleWidth = 1.8, vehicleBottom = -1.43, vehicleTop = -0.23;
+static const double roadZ = -1.73, laneWidth = 3.5;
+
+
+// Vehicles fill five lanes row by row, every other row is shifted by half a lane so that the rows occlude each other less
+static void placeVehicle(int i, double &y, double &distanceCurr, double &closingSpeed)
+{
+    const double laneOffsets[] = {0.0, laneWidth, -laneWidth, 2 * laneWidth, -2 * laneWidth};
+    int lane = i % 5, row = i / 5;
+
+    y = laneOffsets[lane] + (row % 2) * laneWidth / 2;
+    distanceCurr = 8.0 + 5.0 * row + 0.7 * lane;
+    closingSpeed = 1.0 + 0.5 * (i % 7);
+}
+
+
+static bool projectPoint(const double p[3][4], double x, double y, double z, cv::Point2f &pt)
+{
+    double w = p[2][0] * x + p[2][1] * y + p[2][2] * z + p[2][3];
+    if (w <= 0.0)
+        return false;
+    pt.x = (p[0][0] * x + p[0][1] * y + p[0][2] * z + p[0][3]) / w;
+    pt.y = (p[1][0] * x + p[1][1] * y + p[1][2] * z + p[1][3]) / w;
+    return true;
+}
+
+
+// Image region of a vehicle's rear at the given distance, enlarged by the margin and clipped to the image (empty if not visible)
+static cv::Rect vehicleBox(const double p[3][4], double y, double distance, float margin, cv::Size imageSize)
+{
+    float minU = 1e9, minV = 1e9, maxU = -1e9, maxV = -1e9;
+    for (double cornerY : {y - vehicleWidth / 2, y + vehicleWidth / 2})
+    {
+        for (double cornerZ : {vehicleBottom, vehicleTop})
+        {
+            cv::Point2f pt;
+            if (!projectPoint(p, distance, cornerY, cornerZ, pt))
+                return cv::Rect();
+            minU = min(minU, pt.x); maxU = max(maxU, pt.x);
+            minV = min(minV, pt.y); maxV = max(maxV, pt.y);
+        }
+    }
+
+    float marginU = margin * (maxU - minU), marginV = margin * (maxV - minV);
+    cv::Rect roi(cv::Point((int)floor(minU - marginU), (int)floor(minV - marginV)), cv::Point((int)ceil(maxU + marginU), (int)ceil(maxV + marginV)));
+    return roi & cv::Rect(cv::Point(0, 0), imageSize);
+}
+
+
+static void addLidarPoint(LidarPointCloud &points, float x, float y, float z, float r)
+{
+    points.x.push_back(x);
+    points.y.push_back(y);
+    points.z.push_back(z);
+    points.r.push_back(r);
+}
+
+
+// Lidar points of one frame : the rear surfaces of the vehicles at their distance in this frame, then the road and the walls
+// along it (which cropping to the road corridor below the Lidar removes)
+static void generateLidarPoints(const SyntheticWorkloadConfig &config, const vector<SyntheticObject> &objects, const vector<double> &objectY,
+                                bool bPrevFrame, mt19937 &rng, LidarPointCloud &points)
+{
+    uniform_real_distribution<float> unit(0.0f, 1.0f);
+    normal_distribution<float> rangeNoise(0.0f, config.lidarNoise);
+
+    points.resize(0);
+    for (auto *coord : {&points.x, &points.y, &points.z, &points.r})
+        coord->reserve(config.numLidarPoints);
+
+    int pointsPerObject = objects.empty() ? 0 : (int)(config.objectPointFraction * config.numLidarPoints) / (int)objects.size();
+    for (size_t k = 0; k < objects.size(); ++k)
+    {
+        double distance = bPrevFrame ? objects[k].distancePrev : objects[k].distanceCurr;
+        for (int i = 0; i < pointsPerObject; ++i)
+        {
+            float x = distance + fabs(rangeNoise(rng)); // nothing is measured in front of the rear surface
+            float y = objectY[k] + (unit(rng) - 0.5f) * vehicleWidth;
+            float z = vehicleBottom + unit(rng) * (vehicleTop - vehicleBottom);
+            addLidarPoint(points, x, y, z, 0.2f + 0.6f * unit(rng));
+        }
+    }
+
+    int numBackground = config.numLidarPoints - (int)points.size();
+    for (int i = 0; i < numBackground; ++i)
+    {
+        float x = 2.0f + 78.0f * unit(rng);
+        if (i % 2 == 0)
+        {
+            float y = -20.0f + 40.0f * unit(rng);
+            addLidarPoint(points, x, y, roadZ + rangeNoise(rng), 0.1f + 0.3f * unit(rng));
+        }
+        else
+        {
+            float y = (unit(rng) < 0.5f ? -1.0f : 1.0f) * (10.0f + 2.0f * unit(rng));
+            addLidarPoint(points, x, y, roadZ + 4.0f * unit(rng), 0.2f + 0.6f * unit(rng));
+        }
+    }
+}
+
+
+void generateSyntheticFrames(const SyntheticWorkloadConfig &config, cv::Mat &P_rect_xx, cv::Mat &R_rect_xx, cv::Mat &RT,
+                             DataFrame &prevFrame, DataFrame &currFrame, std::vector<SyntheticObject> &objects)
+{
+    cv::Mat P = P_rect_xx * R_rect_xx * RT;
+    double p[3][4];
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 4; ++j)
+            p[i][j] = P.at<double>(i, j);
+
+    mt19937 rng(config.seed);
+    uniform_real_distribution<float> unit(0.0f, 1.0f);
+    normal_distribution<float> pixelNoise(0.0f, config.keypointNoise);
+    double dT = 1.0 / config.frameRate;
+
+    for (DataFrame *frame : {&prevFrame, &currFrame})
+    {
+        *frame = DataFrame();
+        frame->imgFile = "synthetic";
+    }
+
+    // vehicles which are visible in both frames, numbered in the order they are placed in the previous frame
+    objects.clear();
+    vector<double> objectY;
+    for (int i = 0; i < config.numObjects; ++i)
+    {
+        SyntheticObject object;
+        double y;
+        placeVehicle(i, y, object.distanceCurr, object.closingSpeed);
+        object.distancePrev = object.distanceCurr + object.closingSpeed * dT;
+        object.ttc = object.distanceCurr / object.closingSpeed;
+
+        cv::Rect prevRoi = vehicleBox(p, y, object.distancePrev, config.boxMargin, config.imageSize);
+        cv::Rect currRoi = vehicleBox(p, y, object.distanceCurr, config.boxMargin, config.imageSize);
+        if (prevRoi.area() == 0 || currRoi.area() == 0)
+            continue;
+
+        object.prevBoxID = object.currBoxID = (int)objects.size();
+        objects.push_back(object);
+        objectY.push_back(y);
+
+        for (DataFrame *frame : {&prevFrame, &currFrame})
+        {
+            BoundingBox bBox;
+            bBox.boxID = object.prevBoxID;
+            bBox.roi = frame == &prevFrame ? prevRoi : currRoi;
+            bBox.classID = 2; // car
+            bBox.confidence = 1.0;
+            bBox.motion = cv::Point2f(0, 0);
+            frame->boundingBoxes.push_back(bBox);
+        }
+    }
+
+    // box IDs carry no meaning from one frame to the next, so the current frame gets them shuffled
+    vector<int> currBoxIDs(objects.size());
+    for (size_t k = 0; k < objects.size(); ++k)
+        currBoxIDs[k] = (int)k;
+    shuffle(currBoxIDs.begin(), currBoxIDs.end(), rng);
+    for (size_t k = 0; k < objects.size(); ++k)
+    {
+        objects[k].currBoxID = currBoxIDs[k];
+        currFrame.boundingBoxes[k].boxID = currBoxIDs[k];
+    }
+
+    generateLidarPoints(config, objects, objectY, true, rng, prevFrame.lidarPoints);
+    generateLidarPoints(config, objects, objectY, false, rng, currFrame.lidarPoints);
+
+    // keypoints on the vehicles scale about the vanishing point from one frame to the next, prevFrame.keypoints[i] is
+    // the same point as currFrame.keypoints[i]
+    cv::Rect image(cv::Point(0, 0), config.imageSize);
+    int kptsPerObject = objects.empty() ? 0 : (int)(config.objectKeypointFraction * config.numKeypoints) / (int)objects.size();
+    for (size_t k = 0; k < objects.size(); ++k)
+    {
+        for (int i = 0; i < kptsPerObject; ++i)
+        {
+            double y = objectY[k] + (unit(rng) - 0.5f) * vehicleWidth;
+            double z = vehicleBottom + unit(rng) * (vehicleTop - vehicleBottom);
+
+            cv::Point2f prevPt, currPt;
+            projectPoint(p, objects[k].distancePrev, y, z, prevPt);
+            projectPoint(p, objects[k].distanceCurr, y, z, currPt);
+            prevPt += cv::Point2f(pixelNoise(rng), pixelNoise(rng));
+            currPt += cv::Point2f(pixelNoise(rng), pixelNoise(rng));
+            if (!image.contains(prevPt) || !image.contains(currPt))
+                continue; // the part of a vehicle outside the image
+
+            prevFrame.keypoints.push_back(cv::KeyPoint(prevPt, 7.0f));
+            currFrame.keypoints.push_back(cv::KeyPoint(currPt, 7.0f));
+        }
+    }
+
+    // static background far away
+    while ((int)currFrame.keypoints.size() < config.numKeypoints)
+    {
+        cv::Point2f pt(unit(rng) * (config.imageSize.width - 1), unit(rng) * (config.imageSize.height - 1));
+        prevFrame.keypoints.push_back(cv::KeyPoint(pt, 7.0f));
+        currFrame.keypoints.push_back(cv::KeyPoint(pt + cv::Point2f(pixelNoise(rng), pixelNoise(rng)), 7.0f));
+    }
+
+    int numKeypoints = (int)currFrame.keypoints.size();
+    uniform_int_distribution<int> anyKeypoint(0, max(numKeypoints - 1, 0));
+    currFrame.kptMatches.reserve(numKeypoints);
+    for (int i = 0; i < numKeypoints; ++i)
+    {
+        bool bOutlier = unit(rng) < config.outlierFraction;
+        currFrame.kptMatches.push_back(cv::DMatch(i, bOutlier ? anyKeypoint(rng) : i, 0.0f));
+    }
+}
@@ -0,0 +1,45 @@
+
+#ifndef syntheticWorkload_hpp
+#define syntheticWorkload_hpp
+
+#include <stdio.h>
+#include <vector>
+#include <opencv2/core.hpp>
+
+#include "dataStructures.h"
+
+// A synthetic pair of frames: vehicles ahead approach the ego vehicle at constant speed, so their time-to-collision is known.
+// Each vehicle is a vertical rectangle (its rear) carrying Lidar points and keypoints; the rest of the points lie on the road
+// and on walls along it, the rest of the keypoints are static background. Frames are reproducible for a given seed.
+struct SyntheticWorkloadConfig {
+
+    int numObjects = 4; // vehicles, one bounding box each
+    int numLidarPoints = 100000; // per frame, objects and background
+    float objectPointFraction = 0.5; // share of the Lidar points on the vehicles
+    int numKeypoints = 2000; // per frame
+    float objectKeypointFraction = 0.8; // share of the keypoints on the vehicles
+    float outlierFraction = 0.05; // keypoint matches to a random keypoint instead of the true one
+
+    float lidarNoise = 0.02; // std. dev. of the Lidar range in m (behind the rear surface)
+    float keypointNoise = 0.3; // std. dev. of the keypoint position in pixels
+    float boxMargin = 0.1; // bounding boxes extend beyond the vehicle by this fraction of its size on each side
+
+    double frameRate = 10.0; // Hz
+    cv::Size imageSize = cv::Size(1242, 375); // KITTI camera
+    unsigned int seed = 42;
+};
+
+struct SyntheticObject { // ground truth of one vehicle
+
+    int prevBoxID, currBoxID; // the current frame numbers its boxes in a different order, as a detector would
+    double distancePrev, distanceCurr; // of the rear surface along the Lidar x axis, in m
+    double closingSpeed; // m/s
+    double ttc; // distanceCurr / closingSpeed, in s
+};
+
+// Fill prevFrame and currFrame with Lidar points, keypoints, bounding boxes and the keypoint matches (in currFrame); only
+// vehicles visible in both images get a box, their ground truth is stored in objects with objects[k].prevBoxID == k
+void generateSyntheticFrames(const SyntheticWorkloadConfig &config, cv::Mat &P_rect_xx, cv::Mat &R_rect_xx, cv::Mat &RT,
+                             DataFrame &prevFrame, DataFrame &currFrame, std::vector<SyntheticObject> &objects);
+
+#endif /* syntheticWorkload_hpp */
@@ -0,0 +1,90 @@
+
+#include "taskPool.hpp"
+#include "memoryAccounting.hpp"
+
+using namespace std;
+
+
+TaskPool::TaskPool(int numThreads)
+    : numTasks(0), nextTask(0), numDone(0), batch(0), bStop(false)
+{
+    // the thread calling run() is the first worker
+    for (int i = 1; i < numThreads; ++i)
+        workerThreads.push_back(thread(&TaskPool::work, this));
+}
+
+
+TaskPool::~TaskPool()
+{
+    {
+        lock_guard<mutex> lock(mtx);
+        bStop = true;
+    }
+    workerCondition.notify_all();
+
+    for (auto &t : workerThreads)
+        t.join();
+}
+
+
+// Worker thread: sleep until a new batch has been posted, then help working on it
+void TaskPool::work()
+{
+    countThreadAllocations(); // the workers' allocations belong to the stage that posted the batch
+
+    unique_lock<mutex> lock(mtx);
+    unsigned int seenBatch = 0;
+    while (true)
+    {
+        workerCondition.wait(lock, [this, &seenBatch] { return bStop || batch != seenBatch; });
+        if (bStop)
+            return;
+
+        seenBatch = batch;
+        runTasks(lock);
+    }
+}
+
+
+// Claim and execute tasks of the current batch until none are left (called with the lock held)
+void TaskPool::runTasks(std::unique_lock<std::mutex> &lock)
+{
+    while (nextTask < numTasks)
+    {
+        int taskNumber = nextTask++;
+
+        lock.unlock();
+        task(taskNumber);
+        lock.lock();
+
+        if (++numDone == numTasks)
+            doneCondition.notify_all();
+    }
+}
+
+
+void TaskPool::run(int numTasks, Task task)
+{
+    if (numTasks <= 0)
+        return;
+
+    unique_lock<mutex> lock(mtx);
+    this->task = task;
+    this->numTasks = numTasks;
+    nextTask = 0;
+    numDone = 0;
+    batch++;
+    workerCondition.notify_all();
+
+    runTasks(lock);
+    doneCondition.wait(lock, [this] { return numDone == this->numTasks; });
+}
+
+
+std::vector<std::thread::id> TaskPool::workerIds() const
+{
+    vector<thread::id> ids;
+    for (const auto &worker : workerThreads)
+        ids.push_back(worker.get_id());
+    return ids;
+}
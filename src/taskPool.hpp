@@ -0,0 +1,40 @@
+
+#ifndef taskPool_hpp
+#define taskPool_hpp
+
+#include <stdio.h>
+#include <vector>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// Fixed set of worker threads which execute batches of independent tasks. The calling thread works on
+// the batch as well and run() returns once every task of the batch has finished.
+class TaskPool
+{
+public:
+    typedef std::function<void(int)> Task; // called with the task number 0 ... numTasks-1
+
+    explicit TaskPool(int numThreads);
+    ~TaskPool();
+
+    void run(int numTasks, Task task);
+    int numThreads() const { return (int)workerThreads.size() + 1; }
+    std::vector<std::thread::id> workerIds() const; // the worker threads, without the calling thread
+
+private:
+    void work();
+    void runTasks(std::unique_lock<std::mutex> &lock);
+
+    Task task;
+    int numTasks, nextTask, numDone;
+    unsigned int batch; // incremented for every call of run() to wake the workers
+    bool bStop;
+
+    std::mutex mtx;
+    std::condition_variable workerCondition, doneCondition;
+    std::vector<std::thread> workerThreads;
+};
+
+#endif /* taskPool_hpp */